@@ -1,266 +1,857 @@
 #include "maths.h"
 #include "draw.h"
+#include "tessellate.h"
 #include "stick.h"
+#include "record.h"
+#include "latency.h"
+#include "counters.h"
+#include "trace.h"
+#include "sampler.h"
 #include <SDL.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
 #define CAPTION "PadLab"
 #define WINDOW_WIDTH  512
 #define WINDOW_HEIGHT 288
 
+#define DEFAULT_SIM_RATE 1000.0 // Avatar simulation steps per second
+#define MAX_FRAME_TIME   0.25   // Most time simulated in one frame, in seconds
+#define AVATAR_SIZE      32
+#define AVATAR_SPEED     500.0  // Pixels per second at full deflection
+
+#define MAX_PADS 8 // Most controllers shown at once
+#define EVENT_BATCH 64   // Events taken off the queue at a time
+#define NUM_STICK_AXES 4 // Left & right stick axes, which lead SDL's axis enum
+
+#if MAX_PADS > SAMPLER_MAX_PADS
+#error "every controller shown must fit in the input sampler"
+#endif
+
 static SDL_Window* window = NULL;
-static SDL_JoystickID joyid = -1;
-static SDL_GameController* pad = NULL;
+static double inputRate = 0.0; // Sampler thread rate, 0 to use events
+static bool replaying = false; // Sticks are driven by a trace instead of input
+
+// Per-controller state in fixed parallel arrays, the first numPads slots
+// are connected & removal moves the last slot into the hole. Slot 0's
+// panel is shown even with nothing connected so the mouse has one to work
+// with, the first controller then takes it over with its settings intact.
+static SDL_JoystickID padIds[MAX_PADS];
+static SDL_GameController* padHandles[MAX_PADS];
+static StickState padSticks[MAX_PADS][2]; // Left & right stick
+static int numPads = 0;
+
+// Input coalesced while draining the event queue, applied once per frame.
+// Times are the first event's for latency measurement, 0 if nothing's pending.
+typedef struct { int16_t value; uint64_t time; } PendingAxis;
+static PendingAxis pendingAxes[MAX_PADS][NUM_STICK_AXES];
+static SDL_MouseMotionEvent pendingDrag;
+static uint64_t pendingDragTime = 0;
+
+// Trace device ids given slots in the order they appear during replay
+static int32_t replayIds[MAX_PADS];
+static int numReplayIds = 0;
+
+// Find the slot of a connected controller, -1 if there is none.
+static int FindPad(SDL_JoystickID id)
+{
+	for (int i = 0; i < numPads; ++i)
+		if (padIds[i] == id)
+			return i;
+	return -1;
+}
+
+// Give each stick its own draw layer while there are enough to go round.
+static void AssignLayers(void)
+{
+	for (int i = 0; i < MAX_PADS; ++i)
+	{
+		for (int j = 0; j < 2; ++j)
+		{
+			const int layer = i * 2 + j;
+			padSticks[i][j].layer = layer < MAX_DRAW_LAYERS ? layer : -1;
+			padSticks[i][j].restatic = true;
+		}
+	}
+}
+
+static bool DrainSampler(void);
+
+// Stop the sampler, applying what it already took so hot-plugging one
+// controller doesn't drop the samples of the others.
+static void StopSampler(void)
+{
+	SamplerStop();
+	DrainSampler();
+}
+
+static void RestartSampler(void)
+{
+	StopSampler();
+	if (inputRate > 0.0 && numPads > 0 && SamplerStart(padHandles, padIds, numPads, inputRate))
+		fprintf(stderr, "failed to start input sampler, falling back to events\n");
+}
+
+static bool UseGamepad(int deviceIdx)
+{
+	if (numPads == MAX_PADS || FindPad(SDL_JoystickGetDeviceInstanceID(deviceIdx)) >= 0)
+		return false;
+	SDL_GameController* pad = SDL_GameControllerOpen(deviceIdx);
+	if (pad == NULL)
+		return false;
+
+	// The first controller takes over the mouse panel as is
+	const int slot = numPads++;
+	padHandles[slot] = pad;
+	padIds[slot] = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(pad));
+	if (slot > 0)
+	{
+		InitDefaults(&padSticks[slot][0]);
+		InitDefaults(&padSticks[slot][1]);
+	}
+	AssignLayers();
+	printf("using gamepad #%d, \"%s\"\n", deviceIdx, SDL_GameControllerName(pad));
+	RestartSampler();
+	return true;
+}
+
+static bool RemoveGamepad(SDL_JoystickID id)
+{
+	const int slot = FindPad(id);
+	if (slot < 0)
+		return false;
+
+	// Apply the removed controller's samples before its slot is reused
+	StopSampler();
+	SDL_GameControllerClose(padHandles[slot]);
+	if (--numPads > slot)
+	{
+		padIds[slot] = padIds[numPads];
+		padHandles[slot] = padHandles[numPads];
+		memcpy(padSticks[slot], padSticks[numPads], sizeof(padSticks[slot]));
+	}
+	padHandles[numPads] = NULL;
+	padIds[numPads] = -1;
+	AssignLayers();
+	printf("gamepad #%d was removed\n", (int)id);
+	RestartSampler();
+	return true;
+}
+
+// Map a replayed device to a slot, giving new devices the next free one.
+static int ReplaySlot(int32_t device)
+{
+	for (int i = 0; i < numReplayIds; ++i)
+		if (replayIds[i] == device)
+			return i;
+	if (numReplayIds == MAX_PADS)
+		return 0;
+	replayIds[numReplayIds] = device;
+	return numReplayIds++;
+}
+
+// Get the number of panels to show, one per controller or replayed device.
+static inline int NumPanels(void)
+{
+	return MAX(1, MAX(numPads, numReplayIds));
+}
+
+// Get the rect of a panel, tiling them in the grid that fits the largest
+// pair of sticks.
+static rect PanelRect(size area, int count, int idx)
+{
+	int bestCols = 1;
+	double bestSz = 0.0;
+	for (int cols = 1; cols <= count; ++cols)
+	{
+		const int rows = (count + cols - 1) / cols;
+		const double w = (double)area.w / (double)cols / 2.0;
+		const double h = (double)area.h / (double)rows;
+		if (MIN(w, h) > bestSz)
+		{
+			bestSz = MIN(w, h);
+			bestCols = cols;
+		}
+	}
+
+	const int rows = (count + bestCols - 1) / bestCols;
+	const int col = idx % bestCols, row = idx / bestCols;
+	const int x0 = area.w * col / bestCols, x1 = area.w * (col + 1) / bestCols;
+	const int y0 = area.h * row / rows, y1 = area.h * (row + 1) / rows;
+	return (rect){x0, y0, x1 - x0, y1 - y0};
+}
+
+// Find the panel containing a point, -1 if none.
+static int PanelAt(size area, int x, int y)
+{
+	const int count = NumPanels();
+	for (int i = 0; i < count; ++i)
+	{
+		const rect r = PanelRect(area, count, i);
+		if (x >= r.x && x < r.x + r.w && y >= r.y && y < r.y + r.h)
+			return i;
+	}
+	return -1;
+}
 
-static bool UseGamepad(int aJoyid)
+// Tag a stick with the time of an input, keeping the oldest until presented.
+static inline void TagInput(StickState* stick, uint64_t time)
 {
-	pad = SDL_GameControllerOpen(aJoyid);
-	joyid = SDL_JoystickGetDeviceInstanceID(aJoyid);
-	if (pad != NULL)
+	if (!stick->inputTime)
+		stick->inputTime = time;
+}
+
+// Apply a raw axis value to a slot's stick, returns true if a stick was updated.
+//
+// The input time is used for latency measurement, 0 to skip it.
+static bool ApplyAxis(int slot, uint8_t axis, int16_t value, uint64_t time)
+{
+	const vec_t pos = (vec_t)value / (vec_t)0x7FFF;
+	StickState* stick;
+	switch (axis)
+	{
+	case (SDL_CONTROLLER_AXIS_LEFTX):
+		(stick = &padSticks[slot][0])->rawpos.x = pos;
+		break;
+	case (SDL_CONTROLLER_AXIS_LEFTY):
+		(stick = &padSticks[slot][0])->rawpos.y = pos;
+		break;
+	case (SDL_CONTROLLER_AXIS_RIGHTX):
+		(stick = &padSticks[slot][1])->rawpos.x = pos;
+		break;
+	case (SDL_CONTROLLER_AXIS_RIGHTY):
+		(stick = &padSticks[slot][1])->rawpos.y = pos;
+		break;
+	default:
+		return false;
+	}
+	if (time)
+		TagInput(stick, time);
+	return stick->recalc = true;
+}
+
+// Apply every sample taken by the sampler thread in order, so recordings
+// keep the full rate. Returns true if a stick was updated.
+static bool DrainSampler(void)
+{
+	bool updated = false;
+	AxisSample samples[256];
+	size_t count;
+	while ((count = SamplerDrain(samples, sizeof(samples) / sizeof(*samples))) > 0)
+	{
+		for (size_t i = 0; i < count && !replaying; ++i)
+		{
+			const AxisSample* sample = &samples[i];
+			const int slot = FindPad(sample->device);
+			if (slot < 0)
+				continue;
+			RecordAxisAt(sample->device, sample->axis, sample->value, sample->time);
+			if (ApplyAxis(slot, sample->axis, sample->value, sample->time))
+				updated = true;
+		}
+	}
+	return updated;
+}
+
+// Apply a mouse drag to the panel & side it started on.
+//
+// Left dragging moves the stick, right dragging adjusts its parameters.
+//
+// Returns:
+//   true if anything changed.
+static bool ApplyMouseDrag(const SDL_MouseMotionEvent* motion, uint64_t time, size win, int panel, int side)
+{
+	const rect r = PanelRect(win, NumPanels(), panel);
+	const double hw = r.w / 2.0;
+	StickState* stick = &padSticks[panel][side];
+	if (motion->state & SDL_BUTTON_LMASK)
 	{
-		printf("using gamepad #%d, \"%s\"\n", aJoyid, SDL_GameControllerName(pad));
+		const double dispscale = 1.0 / (((hw > r.h) ? r.h : hw) * DISPLAY_SCALE / 2.0);
+		const vector newpos = {
+			CLAMP(((double)(motion->x - r.x) - hw / 2.0 - hw * side) * dispscale, -1.0, 1.0),
+			CLAMP(((double)(motion->y - r.y) - r.h / 2.0) * dispscale, -1.0, 1.0) };
+
+		stick->rawpos = newpos;
+		TagInput(stick, time);
+		stick->recalc = true;
+
+		// Panels with a controller record under its id so replays keep them apart,
+		// at the time of the latest motion rather than when it was applied
+		const int32_t device = panel < numPads ? padIds[panel] : RECORD_DEVICE_MOUSE;
+		const uint64_t motionTime = LatencyEventTime(motion->timestamp);
+		RecordAxisAt(device,
+			side ? SDL_CONTROLLER_AXIS_RIGHTX : SDL_CONTROLLER_AXIS_LEFTX,
+			(int16_t)round(newpos.x * (vec_t)0x7FFF), motionTime);
+		RecordAxisAt(device,
+			side ? SDL_CONTROLLER_AXIS_RIGHTY : SDL_CONTROLLER_AXIS_LEFTY,
+			(int16_t)round(newpos.y * (vec_t)0x7FFF), motionTime);
 		return true;
 	}
+	else if (motion->state & SDL_BUTTON_RMASK)
+	{
+		const double valx = SATURATE(1.0 - (double)(motion->x - r.x) / hw);
+		const double valy = SATURATE(1.0 - (double)(motion->y - r.y) / (double)r.h);
+		if (side == 0)
+		{
+			stick->digiangle = valx;
+			stick->digideadzone = valy;
+			return stick->recalc = stick->restatic = true;
+		}
+		SetCurveTuning(&stick->curve, valy);
+		if (stick->curve.dirty)
+			return stick->recalc = stick->restatic = true;
+	}
 	return false;
 }
 
+// Apply the input coalesced since the last call.
+//
+// Returns:
+//   true if anything changed.
+static bool FlushPendingInput(size win, int panel, int side)
+{
+	bool changed = false;
+	for (int i = 0; i < numPads; ++i)
+	{
+		for (int j = 0; j < NUM_STICK_AXES; ++j)
+		{
+			PendingAxis* pending = &pendingAxes[i][j];
+			if (!pending->time)
+				continue;
+			changed |= ApplyAxis(i, (uint8_t)j, pending->value, pending->time);
+			pending->time = 0;
+		}
+	}
+	if (pendingDragTime)
+	{
+		changed |= ApplyMouseDrag(&pendingDrag, pendingDragTime, win, panel, side);
+		pendingDragTime = 0;
+	}
+	return changed;
+}
+
+// Draw rolling latency percentiles in the top left corner.
+//
+// Returns:
+//   Number of text rows drawn.
+static int DrawLatencyReadout(size rendSize)
+{
+	const int scale = MAX(1, rendSize.h / 288);
+	const int lineh = (FONT_HEIGHT + 3) * scale;
+	char line[64];
+
+	SetDrawColour(GREY5);
+	for (int i = 0; i < NUM_LATENCY_STAGES; ++i)
+	{
+		const LatencySummary sum = GetLatencySummary((LatencyStage)i);
+		snprintf(line, sizeof(line), "%-8s P50 %5.1f P95 %5.1f P99 %5.1f MS",
+			LatencyStageName((LatencyStage)i), sum.p50, sum.p95, sum.p99);
+		DrawString(lineh, lineh * (i + 1), scale, line);
+	}
+	return NUM_LATENCY_STAGES;
+}
+
+// Draw the counters of the previous frame in the top left corner,
+// starting below 'row' lines of other text.
+static void DrawCountersReadout(size rendSize, int row)
+{
+	const int scale = MAX(1, rendSize.h / 288);
+	const int lineh = (FONT_HEIGHT + 3) * scale;
+	char line[64];
+
+	SetDrawColour(GREY5);
+	for (int i = 0; i < NUM_COUNTERS; ++i)
+	{
+		snprintf(line, sizeof(line), "%-15s %8llu",
+			CounterName((Counter)i), (unsigned long long)GetCounter((Counter)i));
+		DrawString(lineh, lineh * (++row), scale, line);
+	}
+	for (int i = 0; i < NUM_TIMERS; ++i)
+	{
+		snprintf(line, sizeof(line), "%-15s %8.3f MS",
+			CounterTimerName((CounterTimer)i), GetCounterTime((CounterTimer)i));
+		DrawString(lineh, lineh * (++row), scale, line);
+	}
+}
+
+// Select a backend, create a window for it & start drawing in it, first
+// shutting down any previous backend & window. The window keeps its last
+// position & size.
+//
+// Returns:
+//   0 on success, -1 on failure, leaving no backend running.
+static int OpenWindow(int idx)
+{
+	static int x = SDL_WINDOWPOS_CENTERED, y = SDL_WINDOWPOS_CENTERED;
+	static int w = WINDOW_WIDTH, h = WINDOW_HEIGHT;
+	if (window)
+	{
+		// Quit while the backend that drew in the window is still selected
+		SDL_GetWindowPosition(window, &x, &y);
+		SDL_GetWindowSize(window, &w, &h);
+		QuitDraw();
+		SDL_DestroyWindow(window);
+		window = NULL;
+	}
+
+	SetDrawBackend(idx);
+	const char* name = GetDrawBackendName(GetDrawBackend());
+	DrawWindowHints();
+	window = SDL_CreateWindow(CAPTION, x, y, w, h,
+		SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI | GetDrawWindowFlags());
+	if (!window || InitDraw(window))
+	{
+		fprintf(stderr, "failed to start %s backend: %s\n", name, SDL_GetError());
+
+		// Release whatever the backend got as far as setting up
+		QuitDraw();
+		if (window)
+			SDL_DestroyWindow(window);
+		window = NULL;
+		return -1;
+	}
+	printf("drawing with %s backend\n", name);
+	return 0;
+}
+
+static void Usage(const char* argv0)
+{
+	fprintf(stderr,
+		"usage: %s [--record FILE] [--replay FILE] [--replay-speed X] [--sim-rate HZ]\n"
+		"          [--latency-csv FILE] [--input-rate HZ] [--trace FILE] [--backend NAME]\n"
+		"  --record FILE     record stick input to a binary trace\n"
+		"  --replay FILE     play back a recorded trace instead of live stick input\n"
+		"  --replay-speed X  playback rate, 1 is real time (default)\n"
+		"                    0 steps one timestamp per frame as fast as possible\n"
+		"  --sim-rate HZ     avatar simulation rate (default %g)\n"
+		"  --latency-csv FILE  write input latency histograms to FILE on exit\n"
+		"  --input-rate HZ   poll the controller on a separate thread at HZ\n"
+		"  --trace FILE      write a Chrome trace-event timeline to FILE (BUILD_TRACE)\n"
+		"  --backend NAME    draw with NAME, one of:",
+		argv0, DEFAULT_SIM_RATE);
+	for (int i = 0; i < GetNumDrawBackends(); ++i)
+		fprintf(stderr, " %s", GetDrawBackendName(i));
+	fprintf(stderr, "\n");
+}
+
 #define FATAL(CONDITION, RETURN) if (CONDITION) { res = (RETURN); goto error; }
 int main(int argc, char** argv)
 {
+	const char* recordPath = NULL;
+	const char* replayPath = NULL;
+	const char* latencyPath = NULL;
+	const char* tracePath = NULL;
+	double replaySpeed = 1.0;
+	double simRate = DEFAULT_SIM_RATE;
 	int res;
 
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--record") && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+			replayPath = argv[++i];
+		else if (!strcmp(argv[i], "--replay-speed") && i + 1 < argc)
+			replaySpeed = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--sim-rate") && i + 1 < argc)
+			simRate = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--latency-csv") && i + 1 < argc)
+			latencyPath = argv[++i];
+		else if (!strcmp(argv[i], "--input-rate") && i + 1 < argc)
+			inputRate = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (!strcmp(argv[i], "--backend") && i + 1 < argc && FindDrawBackend(argv[i + 1]) >= 0)
+			SetDrawBackend(FindDrawBackend(argv[++i]));
+		else
+		{
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+	if (simRate <= 0.0 || inputRate < 0.0)
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
 	res = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER);
 	if (res < 0)
 		goto error;
+	if (tracePath && TraceOpen(tracePath))
+	{
+		fprintf(stderr, "failed to open \"%s\" for tracing\n", tracePath);
+		res = -1;
+		goto error;
+	}
 
-	const int winpos = SDL_WINDOWPOS_CENTERED;
-#ifdef USE_OPENGL
-	const int winflg = SDL_WINDOW_RESIZABLE | SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI;
-#elif defined USE_METAL
-	const int winflg = SDL_WINDOW_RESIZABLE | SDL_WINDOW_METAL | SDL_WINDOW_ALLOW_HIGHDPI;
-#else
-	const int winflg = SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI;
-#endif
-	int winw = WINDOW_WIDTH;
-	int winh = WINDOW_HEIGHT;
-	DrawWindowHints();
-	window = SDL_CreateWindow(CAPTION, winpos, winpos, winw, winh, winflg);
-	FATAL(window == NULL, -1)
-
-	FATAL(InitDraw(window), -1)
+	FATAL(OpenWindow(GetDrawBackend()), -1)
+	int winw, winh;
 	size rendSize = GetDrawSizeInPixels();
+	SDL_GetWindowSize(window, &winw, &winh);
+	SetTessellationDensity((double)rendSize.w / (double)MAX(winw, 1));
+
+	for (int i = 0; i < MAX_PADS; ++i)
+	{
+		padIds[i] = -1;
+		InitDefaults(&padSticks[i][0]);
+		InitDefaults(&padSticks[i][1]);
+	}
+	AssignLayers();
 
 	if ((res = SDL_GameControllerAddMappingsFromFile("gamecontrollerdb.txt")) != -1)
 		printf("read %d mappings from gamecontrollerdb.txt\n", res);
 	for (int i = 0; i < SDL_NumJoysticks(); ++i)
-	{
 		if (SDL_IsGameController(i))
-		{
-			if (UseGamepad(i))
-				break;
-		}
-	}
+			UseGamepad(i);
 
-	vector plrpos = {10.0, 10.0};
-	StickState stickl, stickr;
-	InitDefaults(&stickl);
-	InitDefaults(&stickr);
+	vector plrpos = {10.0, 10.0}, plrlast = plrpos;
+
+	if (recordPath && RecordOpen(recordPath))
+	{
+		fprintf(stderr, "failed to open \"%s\" for recording\n", recordPath);
+		res = -1;
+		goto error;
+	}
+	if (replayPath && ReplayOpen(replayPath, replaySpeed))
+	{
+		fprintf(stderr, "failed to open \"%s\" for replay\n", replayPath);
+		res = -1;
+		goto error;
+	}
+	replaying = replayPath != NULL;
 
 	bool running = true;
 	bool repaint = true;
 	bool showavatar = false;
-	uint32_t tickslast = SDL_GetTicks();
-	int side = 0;
+	bool showlatency = false;
+	bool showcounters = false;
+	int panel = 0, side = 0;
+
+	const double perfPeriod = 1.0 / (double)SDL_GetPerformanceFrequency();
+	const double simStep = 1.0 / simRate;
+	uint64_t countlast = SDL_GetPerformanceCounter();
+	double simAccum = 0.0;
 
 	while (running)
 	{
-		//FIXME: probably doesn't matter but this isn't very precise
-		const uint32_t ticks = SDL_GetTicks();
-		const double framedelta = (double)(ticks - tickslast);
-		tickslast = ticks;
-
-		SDL_Event event;
 		bool onevent = false;
-		if (!showavatar || (stickl.compos.x == 0.0 && stickl.compos.y == 0.0))
+		const StickState* avatarStick = &padSticks[0][0];
+		TRACE_BEGIN("wait");
+		if (showavatar && (avatarStick->compos.x != 0.0 || avatarStick->compos.y != 0.0))
+		{
+			SDL_PumpEvents();
+			onevent = true;
+			repaint = true;
+		}
+		else if (replaying)
 		{
-			onevent = SDL_WaitEvent(&event) != 0;
+			onevent = SDL_WaitEventTimeout(NULL, ReplayTimeout()) != 0;
 		}
 		else
 		{
-			onevent = SDL_PollEvent(&event) > 0;
-			repaint = true;
+			onevent = SDL_WaitEvent(NULL) != 0;
 		}
+		TRACE_END();
 		if (onevent)
 		{
-			do
+			TRACE_BEGIN("dispatch");
+			// Drain the queue in bulk, motion is coalesced & applied once afterwards
+			SDL_Event events[EVENT_BATCH];
+			int numEvents;
+			while ((numEvents = SDL_PeepEvents(events, EVENT_BATCH, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT)) > 0)
 			{
-				switch (event.type)
+				CounterAdd(COUNTER_EVENTS, (uint64_t)numEvents);
+				for (int ev = 0; ev < numEvents; ++ev)
 				{
-				case (SDL_KEYDOWN):
-					if (event.key.keysym.sym == SDLK_ESCAPE)
-					{
-						running = false;
-					}
-					else if (event.key.keysym.sym == SDLK_e)
-					{
-						showavatar = !showavatar;
-						repaint = true;
-					}
-					break;
-
-				case (SDL_CONTROLLERBUTTONDOWN):
-					if (event.cbutton.button == SDL_CONTROLLER_BUTTON_BACK)
-					{
-						showavatar = !showavatar;
-						repaint = true;
-					}
-					break;
-
-				case (SDL_QUIT):
-					running = false;
-					break;
-
-				case (SDL_WINDOWEVENT):
-					if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
-					{
-						winw = event.window.data1;
-						winh = event.window.data2;
-						rendSize = GetDrawSizeInPixels();
-						SetDrawViewport(rendSize);
-						repaint = true;
-					}
-					else if (event.window.event == SDL_WINDOWEVENT_EXPOSED)
-					{
-						repaint = true;
-					}
-					break;
-
-				case (SDL_CONTROLLERAXISMOTION):
-					if (event.caxis.which == joyid)
+					const SDL_Event* event = &events[ev];
+					switch (event->type)
 					{
-						if (event.caxis.axis == SDL_CONTROLLER_AXIS_LEFTX)
+					case (SDL_KEYDOWN):
+						if (event->key.keysym.sym == SDLK_ESCAPE)
 						{
-							stickl.rawpos.x = (vec_t)event.caxis.value / (vec_t)0x7FFF;
-							repaint = stickl.recalc = true;
+							running = false;
 						}
-						else if (event.caxis.axis == SDL_CONTROLLER_AXIS_LEFTY)
+						else if (event->key.keysym.sym == SDLK_e)
 						{
-							stickl.rawpos.y = (vec_t)event.caxis.value / (vec_t)0x7FFF;
-							repaint = stickl.recalc = true;
+							showavatar = !showavatar;
+							repaint = true;
 						}
-						else if (event.caxis.axis == SDL_CONTROLLER_AXIS_RIGHTX)
+						else if (event->key.keysym.sym == SDLK_l)
 						{
-							stickr.rawpos.x = (vec_t)event.caxis.value / (vec_t)0x7FFF;
-							repaint = stickr.recalc = true;
+							showlatency = !showlatency;
+							repaint = true;
 						}
-						else if (event.caxis.axis == SDL_CONTROLLER_AXIS_RIGHTY)
+						else if (event->key.keysym.sym == SDLK_p)
 						{
-							stickr.rawpos.y = (vec_t)event.caxis.value / (vec_t)0x7FFF;
-							repaint = stickr.recalc = true;
+							showcounters = !showcounters;
+							repaint = true;
 						}
-					}
-					break;
+						else if (event->key.keysym.sym == SDLK_b && GetNumDrawBackends() > 1)
+						{
+							// Cycle backends, going back to the current one if the next fails
+							const int last = GetDrawBackend();
+							if (OpenWindow((last + 1) % GetNumDrawBackends()))
+								FATAL(OpenWindow(last), -1)
+							rendSize = GetDrawSizeInPixels();
+							SDL_GetWindowSize(window, &winw, &winh);
+							SetTessellationDensity((double)rendSize.w / (double)MAX(winw, 1));
+							repaint = true;
+						}
+						else if (event->key.keysym.sym == SDLK_c)
+						{
+							// Cycle the curve of the last clicked panel
+							StickState* stick = &padSticks[panel][1];
+							const CurveType type = (CurveType)((stick->curve.type + 1) % NUM_CURVE_TYPES);
+							InitCurve(&stick->curve, type, DefaultCurveParam(type));
+							printf("using %s response curve\n", CurveName(type));
+							repaint = stick->recalc = stick->restatic = true;
+						}
+						break;
 
-				case (SDL_MOUSEBUTTONDOWN):
-					if (event.button.state & (SDL_BUTTON_LMASK | SDL_BUTTON_RMASK ))
-					{
-						side = (event.button.x > winw / 2) ? 1 : 0;
-					}
-					break;
+					case (SDL_CONTROLLERBUTTONDOWN):
+						if (event->cbutton.button == SDL_CONTROLLER_BUTTON_BACK)
+						{
+							showavatar = !showavatar;
+							repaint = true;
+						}
+						break;
 
-				case (SDL_MOUSEMOTION):
-					if (event.motion.state & SDL_BUTTON_LMASK)
-					{
-						const double hwinw = winw / 2.0;
-						const double dispscale = 1.0 / (((hwinw > winh) ? winh : hwinw) * DISPLAY_SCALE / 2.0);
-						const vector newpos = {
-							CLAMP(((double)event.motion.x - hwinw / 2.0 - hwinw * side) * dispscale, -1.0, 1.0),
-							CLAMP(((double)event.motion.y - winh / 2.0) * dispscale, -1.0, 1.0) };
-
-						StickState* stick = side ? &stickr : &stickl;
-						stick->rawpos = newpos;
-						repaint = stick->recalc = true;
-					}
-					else if (event.motion.state & SDL_BUTTON_RMASK)
-					{
-						const double hwinw = winw / 2.0;
-						const double valx = SATURATE(1.0 - (double)event.motion.x / (double)hwinw);
-						const double valy = SATURATE(1.0 - (double)event.motion.y / (double)winh);
+					case (SDL_QUIT):
+						running = false;
+						break;
 
-						if (side == 0)
+					case (SDL_WINDOWEVENT):
+						if (event->window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
 						{
-							stickl.digiangle = valx;
-							stickl.digideadzone = valy;
-							repaint = stickl.recalc = true;
+							winw = event->window.data1;
+							winh = event->window.data2;
+							rendSize = GetDrawSizeInPixels();
+							SetDrawViewport(rendSize);
+							SetTessellationDensity((double)rendSize.w / (double)MAX(winw, 1));
+							repaint = true;
 						}
-						else
+						else if (event->window.event == SDL_WINDOWEVENT_EXPOSED)
 						{
-							//p2.accelpow = valy * valy * valy * 32;
-							stickr.accelpow = pow(valy * 3, 1.0 + valy * 3);
-							repaint = stickr.recalc = true;
+							repaint = true;
 						}
-					}
-					break;
+						break;
 
-				case (SDL_CONTROLLERDEVICEADDED):
-					if (pad == NULL)
-						UseGamepad(event.cdevice.which);
-					break;
+					case (SDL_RENDER_TARGETS_RESET):
+					case (SDL_RENDER_DEVICE_RESET):
+						InvalidateDrawLayers();
+						repaint = true;
+						break;
 
-				case (SDL_CONTROLLERDEVICEREMOVED):
-					if (pad != NULL && event.cdevice.which == joyid)
+					case (SDL_CONTROLLERAXISMOTION):
 					{
-						SDL_GameControllerClose(pad);
-						pad = NULL;
-						printf("active gamepad was removed\n");
+						// Recorded in full but only the latest value per axis is applied
+						const int slot = FindPad(event->caxis.which);
+						if (slot >= 0 && event->caxis.axis < NUM_STICK_AXES && !replaying && !SamplerRunning())
+						{
+							const uint64_t time = LatencyEventTime(event->caxis.timestamp);
+							RecordAxisAt(event->caxis.which, event->caxis.axis, event->caxis.value, time);
+							PendingAxis* pending = &pendingAxes[slot][event->caxis.axis];
+							if (!pending->time)
+								pending->time = time;
+							pending->value = event->caxis.value;
+						}
+						break;
 					}
-					break;
 
-				default:
-					break;
+					case (SDL_MOUSEBUTTONDOWN):
+						if (event->button.state & (SDL_BUTTON_LMASK | SDL_BUTTON_RMASK ))
+						{
+							// Finish any drag before switching panels
+							if (FlushPendingInput((size){winw, winh}, panel, side))
+								repaint = true;
+
+							const int hit = PanelAt((size){winw, winh}, event->button.x, event->button.y);
+							if (hit >= 0)
+							{
+								const rect r = PanelRect((size){winw, winh}, NumPanels(), hit);
+								panel = hit;
+								side = (event->button.x > r.x + r.w / 2) ? 1 : 0;
+							}
+						}
+						break;
+
+					case (SDL_MOUSEMOTION):
+						if (event->motion.state & (SDL_BUTTON_LMASK | SDL_BUTTON_RMASK))
+						{
+							if (!pendingDragTime)
+								pendingDragTime = LatencyEventTime(event->motion.timestamp);
+							pendingDrag = event->motion;
+						}
+						break;
+
+					case (SDL_CONTROLLERDEVICEADDED):
+						if (FlushPendingInput((size){winw, winh}, panel, side))
+							repaint = true;
+						if (UseGamepad(event->cdevice.which))
+							repaint = true;
+						break;
+
+					case (SDL_CONTROLLERDEVICEREMOVED):
+						// Slots move on removal, so apply what's pending to the current ones
+						if (FlushPendingInput((size){winw, winh}, panel, side))
+							repaint = true;
+						if (RemoveGamepad(event->cdevice.which))
+						{
+							panel = MIN(panel, NumPanels() - 1);
+							repaint = true;
+						}
+						break;
+
+					default:
+						// Apply samples in order with the events around them
+						if (event->type == SamplerWakeEvent() && DrainSampler())
+							repaint = true;
+						break;
+					}
 				}
 			}
-			while (SDL_PollEvent(&event) > 0);
+			if (FlushPendingInput((size){winw, winh}, panel, side))
+				repaint = true;
+			TRACE_END();
+		}
+
+		if (SamplerRunning() && DrainSampler())
+			repaint = true;
+
+		if (replaying)
+		{
+			InputRecord record;
+			while (ReplayPoll(&record))
+				if (ApplyAxis(ReplaySlot(record.device), record.axis, record.value, 0))
+					repaint = true;
+
+			if (ReplayFinished())
+			{
+				printf("replay finished\n");
+				ReplayClose();
+				replaying = false;
+			}
+		}
+
+		// Step the avatar at a fixed rate, catching up on the time since last frame
+		const uint64_t count = SDL_GetPerformanceCounter();
+		const double framedelta = MIN((double)(count - countlast) * perfPeriod, MAX_FRAME_TIME);
+		countlast = count;
+		if (showavatar)
+		{
+			const double hplrSz = AVATAR_SIZE / 2.0;
+			for (simAccum += framedelta; simAccum >= simStep; simAccum -= simStep)
+			{
+				const vector next = VecAdd(plrpos, VecScale(avatarStick->compos, simStep * AVATAR_SPEED));
+				plrlast = plrpos;
+				plrpos.x = pfmod(next.x + hplrSz, rendSize.w + AVATAR_SIZE) - hplrSz;
+				plrpos.y = pfmod(next.y + hplrSz, rendSize.h + AVATAR_SIZE) - hplrSz;
+
+				// Wrap the previous position too so interpolation doesn't cross the window
+				plrlast = VecAdd(plrlast, (vector){plrpos.x - next.x, plrpos.y - next.y});
+			}
+		}
+		else
+		{
+			simAccum = 0.0;
+			plrlast = plrpos;
 		}
 
 		if (repaint)
 		{
+			TRACE_BEGIN("frame");
+
 			// background
 			SetDrawColour(GREY1);
 			DrawClear();
 
-			const int hrw = rendSize.w / 2;
-			DrawDigital(&(rect){ 0, 0, hrw, rendSize.h}, &stickl);
-			DrawAnalogue(&(rect){ hrw, 0, hrw, rendSize.h}, &stickr);
+			const int numPanels = NumPanels();
+			for (int i = 0; i < numPanels; ++i)
+			{
+				const rect r = PanelRect(rendSize, numPanels, i);
+				const int hrw = r.w / 2;
+				TRACE_BEGIN("panel");
+				uint64_t start = CounterTimerStart();
+				TRACE_BEGIN("digital");
+				DrawDigital(&(rect){ r.x, r.y, hrw, r.h}, &padSticks[i][0]);
+				TRACE_END();
+				CounterTimerStop(TIMER_DIGITAL, start);
+				start = CounterTimerStart();
+				TRACE_BEGIN("analogue");
+				DrawAnalogue(&(rect){ r.x + hrw, r.y, r.w - hrw, r.h}, &padSticks[i][1]);
+				TRACE_END();
+				CounterTimerStop(TIMER_ANALOGUE, start);
+				TRACE_END();
+			}
 
 			// test player thingo
 			if (showavatar)
 			{
-				const int plrSz = 32;
-				const int hplrSz = plrSz / 2;
-
-				plrpos = VecAdd(plrpos, VecScale(stickl.compos, framedelta * 0.5));
-				plrpos.x = pfmod(plrpos.x + hplrSz, rendSize.w + plrSz) - hplrSz;
-				plrpos.y = pfmod(plrpos.y + hplrSz, rendSize.h + plrSz) - hplrSz;
+				// Interpolate between the last two steps by the time left over
+				const vector drawpos = VecLerp(plrlast, plrpos, simAccum / simStep);
+				const int hplrSz = AVATAR_SIZE / 2;
 
 				SetDrawColour(AVATAR);
 				DrawRect(
-					(int)plrpos.x - hplrSz,
-					(int)plrpos.y - hplrSz,
-					plrSz, plrSz);
+					(int)drawpos.x - hplrSz,
+					(int)drawpos.y - hplrSz,
+					AVATAR_SIZE, AVATAR_SIZE);
 			}
 
+			int rows = 0;
+			if (showlatency)
+				rows += DrawLatencyReadout(rendSize);
+			if (showcounters)
+				DrawCountersReadout(rendSize, rows);
+
+			// Measure from the oldest input shown this frame to either side of the swap
+			uint64_t inputs[MAX_PADS * 2];
+			int numInputs = 0;
+			for (int i = 0; i < numPanels; ++i)
+			{
+				for (int j = 0; j < 2; ++j)
+				{
+					if (padSticks[i][j].inputTime)
+						inputs[numInputs++] = padSticks[i][j].inputTime;
+					padSticks[i][j].inputTime = 0;
+				}
+			}
+			uint64_t now = SDL_GetPerformanceCounter();
+			for (int i = 0; i < numInputs; ++i)
+				LatencyRecord(LATENCY_PRESENT, inputs[i], now);
+			TRACE_BEGIN("present");
 			DrawPresent();
+			TRACE_END();
+			CounterTimerStop(TIMER_PRESENT, now);
+			CountersEndFrame();
+			now = SDL_GetPerformanceCounter();
+			for (int i = 0; i < numInputs; ++i)
+				LatencyRecord(LATENCY_SWAP, inputs[i], now);
 			repaint = false;
+			ReplayStep();
+			TRACE_END();
 		}
 	}
 
 	res = 0;
+	CountersPrintSummary(stdout);
+	if (SamplerDropped())
+		printf("input sampler dropped %u samples with a full ring\n", SamplerDropped());
+	if (latencyPath && LatencyWriteCSV(latencyPath))
+		fprintf(stderr, "failed to write latency histograms to \"%s\"\n", latencyPath);
 error:
-	SDL_GameControllerClose(pad);
+	RecordClose();
+	ReplayClose();
+	SamplerStop();
+	for (int i = 0; i < numPads; ++i)
+		SDL_GameControllerClose(padHandles[i]);
 	QuitDraw();
-	SDL_DestroyWindow(window);
+	TraceClose();
+	if (window)
+		SDL_DestroyWindow(window);
 	SDL_Quit();
 	return res;
 }
@@ -0,0 +1,308 @@
+#include "maths.h"
+#include "draw.h"
+#include "stick.h"
+#include "counters.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define CAPTION "PadLab Bench"
+#define BENCH_WIDTH  1024
+#define BENCH_HEIGHT 576
+
+#define DEFAULT_FRAMES 240
+#define WARMUP_FRAMES  16
+
+typedef struct
+{
+	const char* name;
+	const char* unit;
+	int perFrame;
+	void (*issue)(int count, size canvas);
+} Benchmark;
+
+static SDL_Window* window = NULL;
+static StickState stickl, stickr;
+static uint32_t rngState = 0x9E3779B9;
+
+// Deterministic xorshift so every backend gets identical geometry
+static inline int Rand(int max)
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return (int)(rngState % (uint32_t)max);
+}
+
+
+static void IssueLines(int count, size canvas)
+{
+	for (int i = 0; i < count; ++i)
+		DrawLine(
+			Rand(canvas.w), Rand(canvas.h),
+			Rand(canvas.w), Rand(canvas.h));
+}
+
+static void IssueRects(int count, size canvas)
+{
+	for (int i = 0; i < count; ++i)
+		DrawRect(
+			Rand(canvas.w), Rand(canvas.h),
+			Rand(canvas.w / 4) + 1, Rand(canvas.h / 4) + 1);
+}
+
+static void IssueCircles(int count, size canvas)
+{
+	for (int i = 0; i < count; ++i)
+		DrawCircleSteps(Rand(canvas.w), Rand(canvas.h), Rand(64) + 4, 32);
+}
+
+static void IssueArcs(int count, size canvas)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		const int start = Rand(360);
+		DrawArcSteps(Rand(canvas.w), Rand(canvas.h), Rand(64) + 4, start, start + 135, 12);
+	}
+}
+
+// Circles & arcs through the analytic path where the backend supports it
+static void IssueSmoothCircles(int count, size canvas)
+{
+	for (int i = 0; i < count; ++i)
+		DrawCircle(Rand(canvas.w), Rand(canvas.h), Rand(64) + 4);
+}
+
+static void IssueSmoothArcs(int count, size canvas)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		const int start = Rand(360);
+		DrawArc(Rand(canvas.w), Rand(canvas.h), Rand(64) + 4, start, start + 135);
+	}
+}
+
+static void IssuePoints(int count, size canvas)
+{
+	for (int i = 0; i < count; ++i)
+		DrawPoint(Rand(canvas.w), Rand(canvas.h));
+}
+
+static void IssueScene(int count, size canvas)
+{
+	// Sweep both sticks around the rim so the highlight paths get exercised
+	static int frame = 0;
+	const double theta = (double)(frame++ % 360) * DEG2RAD;
+	stickl.rawpos = stickr.rawpos = (vector){cos(theta), sin(theta)};
+	stickl.recalc = stickr.recalc = true;
+
+	const int hrw = canvas.w / 2;
+	DrawDigital(&(rect){ 0, 0, hrw, canvas.h}, &stickl);
+	DrawAnalogue(&(rect){ hrw, 0, hrw, canvas.h}, &stickr);
+}
+
+static void IssueSceneLayered(int count, size canvas)
+{
+	// Same as the scene but with static elements retained in layers
+	stickl.layer = 0;
+	stickr.layer = 1;
+	IssueScene(count, canvas);
+	stickl.layer = stickr.layer = -1;
+}
+
+static const Benchmark benchmarks[] =
+{
+	{ "DrawLine",        "lines",   2000, IssueLines },
+	{ "DrawRect",        "rects",    500, IssueRects },
+	{ "DrawCircleSteps", "circles",  250, IssueCircles },
+	{ "DrawArcSteps",    "arcs",     500, IssueArcs },
+	{ "DrawCircle",      "circles",  250, IssueSmoothCircles },
+	{ "DrawArc",         "arcs",     500, IssueSmoothArcs },
+	{ "DrawPoint",       "points",  2000, IssuePoints },
+	{ "Scene",           "frames",     1, IssueScene },
+	{ "SceneLayered",    "frames",     1, IssueSceneLayered }
+};
+
+
+static int CompareDouble(const void* a, const void* b)
+{
+	const double l = *(const double*)a, r = *(const double*)b;
+	return (l > r) - (l < r);
+}
+
+static double Percentile(const double* sorted, int num, double pct)
+{
+	const int idx = (int)ceil(pct / 100.0 * (double)num) - 1;
+	return sorted[CLAMP(idx, 0, num - 1)];
+}
+
+static void RunBenchmark(const Benchmark* bench, int frames, double scale, double* frameTimes)
+{
+	const double freq = (double)SDL_GetPerformanceFrequency();
+	const int count = MAX(1, (int)((double)bench->perFrame * scale));
+	unsigned long long drawCalls = 0, flushes = 0, vertices = 0;
+	double total = 0.0;
+
+	rngState = 0x9E3779B9;
+	for (int i = -WARMUP_FRAMES; i < frames; ++i)
+	{
+		const size canvas = GetDrawSizeInPixels();
+		const uint64_t start = SDL_GetPerformanceCounter();
+
+		SetDrawColour(GREY1);
+		DrawClear();
+		SetDrawColour(GREY5);
+		bench->issue(count, canvas);
+		DrawPresent();
+		CountersEndFrame();
+
+		const double elapsed = (double)(SDL_GetPerformanceCounter() - start) / freq;
+		if (i < 0)
+			continue;
+
+		drawCalls += GetCounter(COUNTER_DRAW_CALLS);
+		flushes += GetCounter(COUNTER_FLUSHES);
+		vertices += GetCounter(COUNTER_VERTICES);
+		frameTimes[i] = elapsed * 1000.0;
+		total += elapsed;
+
+		// Keep the window responsive on compositors that care
+		SDL_PumpEvents();
+	}
+
+	qsort(frameTimes, (size_t)frames, sizeof(double), CompareDouble);
+	printf("{\"backend\":\"%s\",\"bench\":\"%s\",\"frames\":%d,\"per_frame\":%d,"
+		"\"rate\":%.1f,\"unit\":\"%s/s\","
+		"\"frame_ms\":{\"mean\":%.4f,\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f,\"max\":%.4f},"
+		"\"draw_calls\":%.2f,\"flushes\":%.2f,\"vertices\":%.1f}\n",
+		GetDrawBackendName(GetDrawBackend()), bench->name, frames, count,
+		(double)count * (double)frames / total, bench->unit,
+		total * 1000.0 / (double)frames,
+		Percentile(frameTimes, frames, 50.0),
+		Percentile(frameTimes, frames, 90.0),
+		Percentile(frameTimes, frames, 99.0),
+		frameTimes[frames - 1],
+		(double)drawCalls / (double)frames,
+		(double)flushes / (double)frames,
+		(double)vertices / (double)frames);
+	fflush(stdout);
+}
+
+// Run benchmarks on the selected backend in a fresh hidden window.
+//
+// Returns:
+//   0 on success, -1 if the backend couldn't be started.
+static int RunBackend(const char* only, int frames, double scale, double* frameTimes)
+{
+	DrawWindowHints();
+	window = SDL_CreateWindow(CAPTION, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+		BENCH_WIDTH, BENCH_HEIGHT, SDL_WINDOW_HIDDEN | SDL_WINDOW_ALLOW_HIGHDPI | GetDrawWindowFlags());
+
+	int res = -1;
+	if (window && !InitDraw(window))
+	{
+		if (GetDrawWindowFlags() & SDL_WINDOW_OPENGL)
+			SDL_GL_SetSwapInterval(0);
+		SetDrawViewport(GetDrawSizeInPixels());
+
+		InitDefaults(&stickl);
+		InitDefaults(&stickr);
+		for (int i = 0; i < (int)(sizeof(benchmarks) / sizeof(Benchmark)); ++i)
+		{
+			if (only && strcmp(only, benchmarks[i].name))
+				continue;
+			RunBenchmark(&benchmarks[i], frames, scale, frameTimes);
+		}
+		res = 0;
+	}
+	else
+	{
+		fprintf(stderr, "failed to start %s backend: %s\n",
+			GetDrawBackendName(GetDrawBackend()), SDL_GetError());
+	}
+
+	QuitDraw();
+	if (window)
+		SDL_DestroyWindow(window);
+	window = NULL;
+	return res;
+}
+
+static void Usage(const char* argv0)
+{
+	fprintf(stderr,
+		"usage: %s [--frames N] [--scale X] [--only NAME] [--backend NAME]\n"
+		"  --frames N      measured frames per benchmark (default %d)\n"
+		"  --scale X       multiply primitives issued per frame by X\n"
+		"  --only NAME     only run the named benchmark\n"
+		"  --backend NAME  only run on the named backend, may be repeated\n"
+		"Every backend is run by default, of:",
+		argv0, DEFAULT_FRAMES);
+	for (int i = 0; i < GetNumDrawBackends(); ++i)
+		fprintf(stderr, " %s", GetDrawBackendName(i));
+	fprintf(stderr, "\n"
+		"Results are written to stdout as one JSON object per line.\n"
+		"Set SDL_VIDEODRIVER=offscreen to run without a display.\n");
+}
+
+#define FATAL(CONDITION, RETURN) if (CONDITION) { res = (RETURN); goto error; }
+int main(int argc, char** argv)
+{
+	int frames = DEFAULT_FRAMES;
+	double scale = 1.0;
+	const char* only = NULL;
+	unsigned backendMask = 0; // Bit per backend index, 0 runs every one
+	double* frameTimes = NULL;
+	int res;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--scale") && i + 1 < argc)
+			scale = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--only") && i + 1 < argc)
+			only = argv[++i];
+		else if (!strcmp(argv[i], "--backend") && i + 1 < argc && FindDrawBackend(argv[i + 1]) >= 0)
+			backendMask |= 1u << FindDrawBackend(argv[++i]);
+		else
+		{
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+	if (frames < 1 || scale <= 0.0)
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
+	// Measure raw throughput, not the display refresh rate
+	SDL_SetHint(SDL_HINT_RENDER_VSYNC, "0");
+
+	res = SDL_Init(SDL_INIT_VIDEO);
+	if (res < 0)
+		goto error;
+
+	frameTimes = malloc(sizeof(double) * (size_t)frames);
+	FATAL(frameTimes == NULL, -1)
+
+	// Each backend gets its own window, as they need different window flags
+	bool failed = false;
+	for (int i = 0; i < GetNumDrawBackends(); ++i)
+	{
+		if (backendMask && !(backendMask & (1u << i)))
+			continue;
+		SetDrawBackend(i);
+		failed |= RunBackend(only, frames, scale, frameTimes) != 0;
+	}
+	res = failed ? 1 : 0;
+error:
+	if (res < 0)
+		fprintf(stderr, "%s\n", SDL_GetError());
+	free(frameTimes);
+	SDL_Quit();
+	return res ? 1 : 0;
+}
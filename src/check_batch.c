@@ -0,0 +1,107 @@
+#include "maths.h"
+#include "stick.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#define GRID_STEPS 201 // Samples along each axis, covering [-GRID_EXTENT, GRID_EXTENT]
+#define GRID_EXTENT 1.2
+#define GRID_SIZE (GRID_STEPS * GRID_STEPS)
+
+static const char* const kernelNames[] = { "avx2", "sse2", "scalar" };
+static const double deadzones[] = { 0.0, 0.125, 0.4 };
+
+static double inX[GRID_SIZE], inY[GRID_SIZE];
+static double outX[GRID_SIZE], outY[GRID_SIZE];
+
+static void FillGrid(void)
+{
+	for (int i = 0; i < GRID_SIZE; ++i)
+	{
+		outX[i] = inX[i] = GRID_EXTENT * (2.0 * (double)(i % GRID_STEPS) / (GRID_STEPS - 1) - 1.0);
+		outY[i] = inY[i] = GRID_EXTENT * (2.0 * (double)(i / GRID_STEPS) / (GRID_STEPS - 1) - 1.0);
+	}
+}
+
+static double MaxError(vector (*expect)(vector v, StickState* p), StickState* p)
+{
+	double err = 0.0;
+	for (int i = 0; i < GRID_SIZE; ++i)
+	{
+		const vector v = expect((vector){inX[i], inY[i]}, p);
+		err = MAX(err, MAX(fabs(outX[i] - v.x), fabs(outY[i] - v.y)));
+	}
+	return err;
+}
+
+static vector ExpectDeadzone(vector v, StickState* p)
+{
+	return RadialDeadzone(v, p->deadzone, ANALOGUE_OUTER_DEADZONE);
+}
+
+static vector ExpectAcceleration(vector v, StickState* p)
+{
+	return ApplyAcceleration(v, &p->curve);
+}
+
+static vector ExpectAnalogue(vector v, StickState* p)
+{
+	return ApplyAcceleration(ExpectDeadzone(v, p), &p->curve);
+}
+
+// Compare every batch function of one kernel against the single sample
+// pipeline over a grid reaching past the outer deadzone
+static bool CheckKernel(const char* kernel)
+{
+	bool pass = true;
+	StickState stick;
+	InitDefaults(&stick);
+	for (int c = 0; c < NUM_CURVE_TYPES; ++c)
+	{
+		InitCurve(&stick.curve, (CurveType)c, DefaultCurveParam((CurveType)c));
+		for (size_t d = 0; d < sizeof(deadzones) / sizeof(*deadzones); ++d)
+		{
+			stick.deadzone = deadzones[d];
+
+			FillGrid();
+			RadialDeadzoneBatch(outX, outY, GRID_SIZE, stick.deadzone, ANALOGUE_OUTER_DEADZONE);
+			const double deadzoneErr = MaxError(ExpectDeadzone, &stick);
+			FillGrid();
+			ApplyAccelerationBatch(outX, outY, GRID_SIZE, &stick.curve);
+			const double accelErr = MaxError(ExpectAcceleration, &stick);
+			FillGrid();
+			AnalogueBatch(outX, outY, GRID_SIZE, &stick);
+			const double analogueErr = MaxError(ExpectAnalogue, &stick);
+
+			const bool ok =
+				deadzoneErr <= BATCH_TOLERANCE &&
+				accelErr <= BATCH_TOLERANCE &&
+				analogueErr <= BATCH_TOLERANCE;
+			printf("{\"check\":\"batch\",\"kernel\":\"%s\",\"curve\":\"%s\",\"deadzone\":%g,"
+				"\"deadzone_err\":%.3g,\"accel_err\":%.3g,\"analogue_err\":%.3g,\"tolerance\":%.3g,\"pass\":%s}\n",
+				kernel, CurveName((CurveType)c), stick.deadzone,
+				deadzoneErr, accelErr, analogueErr, BATCH_TOLERANCE,
+				ok ? "true" : "false");
+			pass &= ok;
+		}
+	}
+	fflush(stdout);
+	return pass;
+}
+
+// Check every batch kernel the CPU supports, exiting non-zero if any
+// strays past the tolerance documented in stick.h
+int main(int argc, char** argv)
+{
+	bool pass = true;
+	for (size_t i = 0; i < sizeof(kernelNames) / sizeof(*kernelNames); ++i)
+	{
+		if (!SetStickBatchKernel(kernelNames[i]))
+		{
+			printf("{\"check\":\"batch\",\"kernel\":\"%s\",\"skipped\":true}\n", kernelNames[i]);
+			continue;
+		}
+		pass &= CheckKernel(kernelNames[i]);
+	}
+	return pass ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include "maths.h"
+#include "stick.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+// Distance from the nearest DigitalEight zone boundary
+static double DigitalBoundaryDistance(vector v, double angle, double deadzone)
+{
+	const double absx = fabs(v.x), absy = fabs(v.y);
+	double dist = fabs(absx * angle - absy);
+	dist = MIN(dist, fabs(absy * angle - absx));
+	dist = MIN(dist, fabs(absx - deadzone));
+	dist = MIN(dist, fabs(absy - deadzone));
+	return MIN(dist, fabs(absx + absy - deadzone * (1.0 + angle)));
+}
+
+static inline double MaxError(vector v, fxvector fx)
+{
+	return MAX(fabs(FxToDouble(fx.x) - v.x), fabs(FxToDouble(fx.y) - v.y));
+}
+
+// Compare the fixed point pipeline against the double path, sweeping every
+// int16 value along one axis for a spread of values on the other
+static bool CheckFixedCurve(StickState* p)
+{
+	const fixed_t min = FxFromDouble(p->deadzone);
+	const fixed_t max = FxFromDouble(ANALOGUE_OUTER_DEADZONE);
+	const fixed_t angle = FxFromDouble(p->digiangle);
+	const fixed_t digidz = FxFromDouble(p->digideadzone);
+	const fixed_t* table = GetCurveTableFx(&p->curve);
+
+	double deadzoneErr = 0.0, accelErr = 0.0;
+	unsigned long long samples = 0, mismatches = 0, violations = 0;
+	for (int j = INT16_MIN; j <= INT16_MAX; j += 257)
+	{
+		for (int i = INT16_MIN; i <= INT16_MAX; ++i)
+		{
+			for (int swap = 0; swap < 2; ++swap)
+			{
+				const int16_t rx = (int16_t)(swap ? j : i), ry = (int16_t)(swap ? i : j);
+				const vector v = {(vec_t)rx / (vec_t)0x7FFF, (vec_t)ry / (vec_t)0x7FFF};
+				const fxvector fv = {FxFromAxis(rx), FxFromAxis(ry)};
+
+				const vector dz = RadialDeadzone(v, p->deadzone, ANALOGUE_OUTER_DEADZONE);
+				const fxvector fdz = RadialDeadzoneFx(fv, min, max);
+				deadzoneErr = MAX(deadzoneErr, MaxError(dz, fdz));
+				accelErr = MAX(accelErr, MaxError(
+					ApplyAcceleration(dz, &p->curve),
+					ApplyAccelerationFx(fdz, table)));
+
+				const point digi = DigitalEight(v, p->digiangle, p->digideadzone);
+				const point fdigi = DigitalEightFx(fv, angle, digidz);
+				if (digi.x != fdigi.x || digi.y != fdigi.y)
+				{
+					++mismatches;
+					if (DigitalBoundaryDistance(v, p->digiangle, p->digideadzone) > FIXED_TOLERANCE)
+						++violations;
+				}
+				++samples;
+			}
+		}
+	}
+
+	const bool pass =
+		deadzoneErr <= FIXED_DEADZONE_TOLERANCE &&
+		accelErr <= FIXED_TOLERANCE &&
+		!violations;
+	printf("{\"check\":\"fixed\",\"curve\":\"%s\",\"samples\":%llu,"
+		"\"deadzone_err\":%.3g,\"deadzone_tolerance\":%.3g,\"accel_err\":%.3g,\"tolerance\":%.3g,"
+		"\"digital_mismatches\":%llu,\"digital_violations\":%llu,\"pass\":%s}\n",
+		CurveName(p->curve.type), samples,
+		deadzoneErr, FIXED_DEADZONE_TOLERANCE, accelErr, FIXED_TOLERANCE,
+		mismatches, violations, pass ? "true" : "false");
+	fflush(stdout);
+	return pass;
+}
+
+// Check every curve type against the tolerances documented in stick.h,
+// exiting non-zero if any is exceeded
+int main(int argc, char** argv)
+{
+	bool pass = true;
+	StickState stick;
+	InitDefaults(&stick);
+	for (int i = 0; i < NUM_CURVE_TYPES; ++i)
+	{
+		InitCurve(&stick.curve, (CurveType)i, DefaultCurveParam((CurveType)i));
+		pass &= CheckFixedCurve(&stick);
+	}
+	return pass ? 0 : 1;
+}
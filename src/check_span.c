@@ -0,0 +1,124 @@
+#include "soft/span.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define NUM_SPANS 200000
+#define MAX_SPAN 70   // Long enough for full SIMD blocks plus every tail length
+#define MAX_OFFSET 7  // Misaligns the start of each span within its row
+#define ROW_SIZE (MAX_OFFSET + MAX_SPAN + 8) // Pixels past the span catch overruns
+
+static const char* const kernelNames[] = { "avx2", "sse2", "scalar" };
+
+typedef enum
+{
+	COVERAGE_RANDOM, // Any value, mostly partial blending
+	COVERAGE_RUNS,   // Runs of empty & full pixels, for the skip & fill paths
+	COVERAGE_SPARSE, // Mostly empty with the odd partial pixel
+	NUM_COVERAGE
+} CoverageKind;
+
+static const char* const coverageNames[NUM_COVERAGE] = { "random", "runs", "sparse" };
+
+// xorshift32, the same sequence on every platform
+static uint32_t Random(uint32_t* state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static void FillCoverage(uint8_t* cov, int count, CoverageKind kind, uint32_t* rng)
+{
+	for (int i = 0; i < count;)
+	{
+		switch (kind)
+		{
+		case COVERAGE_RUNS:
+		{
+			const int run = 1 + (int)(Random(rng) % 12);
+			const uint8_t value = (Random(rng) & 1) ? 0xFF : 0x00;
+			for (int j = 0; j < run && i < count; ++j)
+				cov[i++] = value;
+			break;
+		}
+		case COVERAGE_SPARSE:
+			cov[i++] = (Random(rng) % 8) ? 0 : (uint8_t)Random(rng);
+			break;
+		default:
+			cov[i++] = (uint8_t)Random(rng);
+			break;
+		}
+	}
+}
+
+// Pick a colour, with opaque & fully transparent ones common enough to
+// reach the kernels' special cases
+static uint32_t RandomColour(uint32_t* rng)
+{
+	uint32_t c = Random(rng);
+	switch (Random(rng) % 4)
+	{
+	case 0: c |= 0x000000FF; break;
+	case 1: c &= 0xFFFFFF00; break;
+	default: break;
+	}
+	return SpanPackColour(c, true);
+}
+
+// Blend the same random spans with one kernel & the scalar reference,
+// counting rows that differ in any byte
+static bool CheckKernel(const char* kernel, CoverageKind kind)
+{
+	uint32_t rng = 0x9E3779B9u + (uint32_t)kind;
+	uint32_t expect[ROW_SIZE], actual[ROW_SIZE];
+	uint8_t cov[MAX_SPAN];
+
+	int mismatches = 0;
+	for (int n = 0; n < NUM_SPANS; ++n)
+	{
+		for (int i = 0; i < ROW_SIZE; ++i)
+			expect[i] = Random(&rng);
+		memcpy(actual, expect, sizeof(actual));
+
+		const int offset = (int)(Random(&rng) % (MAX_OFFSET + 1));
+		const int count = (int)(Random(&rng) % (MAX_SPAN + 1));
+		const uint32_t colour = RandomColour(&rng);
+		FillCoverage(cov, count, kind, &rng);
+
+		SetSpanKernel("scalar");
+		SpanBlend(&expect[offset], cov, count, colour);
+		SetSpanKernel(kernel);
+		SpanBlend(&actual[offset], cov, count, colour);
+
+		if (memcmp(expect, actual, sizeof(expect)))
+			++mismatches;
+	}
+
+	const bool pass = mismatches == 0;
+	printf("{\"check\":\"span\",\"kernel\":\"%s\",\"coverage\":\"%s\",\"spans\":%d,\"mismatches\":%d,\"pass\":%s}\n",
+		kernel, coverageNames[kind], NUM_SPANS, mismatches, pass ? "true" : "false");
+	fflush(stdout);
+	return pass;
+}
+
+// Check every span kernel the CPU supports gives pixels bit identical to
+// the scalar kernel, exiting non-zero if any differ
+int main(int argc, char** argv)
+{
+	bool pass = true;
+	for (size_t i = 0; i < sizeof(kernelNames) / sizeof(*kernelNames); ++i)
+	{
+		if (!SetSpanKernel(kernelNames[i]))
+		{
+			printf("{\"check\":\"span\",\"kernel\":\"%s\",\"skipped\":true}\n", kernelNames[i]);
+			continue;
+		}
+		for (int kind = 0; kind < NUM_COVERAGE; ++kind)
+			pass &= CheckKernel(kernelNames[i], (CoverageKind)kind);
+	}
+	return pass ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+#include "counters.h"
+#include "util.h"
+#include <SDL_timer.h>
+
+typedef struct
+{
+	uint64_t last, total, max;
+} Totals;
+
+uint64_t counterValues[NUM_COUNTERS];
+static uint64_t timerTicks[NUM_TIMERS];
+
+static Totals counters[NUM_COUNTERS];
+static Totals timers[NUM_TIMERS];
+static uint64_t frames = 0;
+static double msPerTick = 0.0;
+
+
+uint64_t CounterTimerStart(void)
+{
+	return SDL_GetPerformanceCounter();
+}
+
+void CounterTimerStop(CounterTimer timer, uint64_t start)
+{
+	timerTicks[timer] += SDL_GetPerformanceCounter() - start;
+}
+
+static void Latch(Totals* t, uint64_t value)
+{
+	t->last = value;
+	t->total += value;
+	t->max = MAX(t->max, value);
+}
+
+void CountersEndFrame(void)
+{
+	for (int i = 0; i < NUM_COUNTERS; ++i)
+	{
+		Latch(&counters[i], counterValues[i]);
+		counterValues[i] = 0;
+	}
+	for (int i = 0; i < NUM_TIMERS; ++i)
+	{
+		Latch(&timers[i], timerTicks[i]);
+		timerTicks[i] = 0;
+	}
+	++frames;
+}
+
+static inline double TicksToMs(uint64_t ticks)
+{
+	if (msPerTick == 0.0)
+		msPerTick = 1e3 / (double)SDL_GetPerformanceFrequency();
+	return (double)ticks * msPerTick;
+}
+
+uint64_t GetCounter(Counter counter)
+{
+	return counters[counter].last;
+}
+
+double GetCounterTime(CounterTimer timer)
+{
+	return TicksToMs(timers[timer].last);
+}
+
+CounterSummary GetCounterSummary(Counter counter)
+{
+	const Totals* t = &counters[counter];
+	if (!frames)
+		return (CounterSummary){0, 0.0, 0.0};
+	return (CounterSummary){frames, (double)t->total / (double)frames, (double)t->max};
+}
+
+CounterSummary GetCounterTimeSummary(CounterTimer timer)
+{
+	const Totals* t = &timers[timer];
+	if (!frames)
+		return (CounterSummary){0, 0.0, 0.0};
+	return (CounterSummary){frames, TicksToMs(t->total) / (double)frames, TicksToMs(t->max)};
+}
+
+const char* CounterName(Counter counter)
+{
+	switch (counter)
+	{
+	case (COUNTER_DRAW_CALLS):     return "draw calls";
+	case (COUNTER_FLUSHES):        return "flushes";
+	case (COUNTER_VERTICES):       return "vertices";
+	case (COUNTER_INDICES):        return "indices";
+	case (COUNTER_COLOUR_CHANGES): return "colour changes";
+	case (COUNTER_EVENTS):         return "events";
+	case (COUNTER_RECALCS):        return "recalcs";
+	default: return "unknown";
+	}
+}
+
+const char* CounterTimerName(CounterTimer timer)
+{
+	switch (timer)
+	{
+	case (TIMER_DIGITAL):  return "digital";
+	case (TIMER_ANALOGUE): return "analogue";
+	case (TIMER_PRESENT):  return "present";
+	default: return "unknown";
+	}
+}
+
+void CountersPrintSummary(FILE* file)
+{
+	if (!frames)
+		return;
+
+	fprintf(file, "%llu frames, per frame mean / max:\n", (unsigned long long)frames);
+	for (int i = 0; i < NUM_COUNTERS; ++i)
+	{
+		const CounterSummary sum = GetCounterSummary((Counter)i);
+		fprintf(file, "  %-15s %10.1f / %.0f\n", CounterName((Counter)i), sum.mean, sum.max);
+	}
+	for (int i = 0; i < NUM_TIMERS; ++i)
+	{
+		const CounterSummary sum = GetCounterTimeSummary((CounterTimer)i);
+		fprintf(file, "  %-15s %7.3f ms / %.3f ms\n", CounterTimerName((CounterTimer)i), sum.mean, sum.max);
+	}
+}
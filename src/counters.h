@@ -0,0 +1,75 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Per-frame performance counters shared by the app & every drawing backend.
+// Counts are only added from the main thread.
+
+typedef enum
+{
+	COUNTER_DRAW_CALLS,     // Primitive submissions made to the underlying API
+	COUNTER_FLUSHES,        // Times buffered geometry was flushed to the GPU
+	COUNTER_VERTICES,       // Vertices submitted
+	COUNTER_INDICES,        // Indices submitted
+	COUNTER_COLOUR_CHANGES, // Draw colour switches reaching the backend
+	COUNTER_EVENTS,         // Events taken off the queue
+	COUNTER_RECALCS,        // Stick pipeline passes run on new input
+	NUM_COUNTERS
+} Counter;
+
+typedef enum
+{
+	TIMER_DIGITAL,  // DrawDigital for every panel
+	TIMER_ANALOGUE, // DrawAnalogue for every panel
+	TIMER_PRESENT,  // DrawPresent, including the swap
+	NUM_TIMERS
+} CounterTimer;
+
+typedef struct
+{
+	uint64_t frames; // Frames ended so far
+	double mean;     // Average per frame
+	double max;      // Highest single frame
+} CounterSummary;
+
+extern uint64_t counterValues[NUM_COUNTERS];
+
+// Add to a counter for the current frame.
+static inline void CounterAdd(Counter counter, uint64_t amount)
+{
+	counterValues[counter] += amount;
+}
+
+// Get a performance counter value to pass to CounterTimerStop.
+uint64_t CounterTimerStart(void);
+
+// Add the time since a CounterTimerStart call to a timer.
+//
+// Params:
+//   timer - Timer to add to.
+//   start - Value CounterTimerStart returned.
+void CounterTimerStop(CounterTimer timer, uint64_t start);
+
+// Latch the counts of the current frame & start a new one.
+void CountersEndFrame(void);
+
+// Get a counter value for the most recently ended frame.
+uint64_t GetCounter(Counter counter);
+
+// Get a timer value for the most recently ended frame in milliseconds.
+double GetCounterTime(CounterTimer timer);
+
+// Get the mean & worst frame of a counter, or of a timer in milliseconds.
+CounterSummary GetCounterSummary(Counter counter);
+CounterSummary GetCounterTimeSummary(CounterTimer timer);
+
+// Get human readable counter & timer names.
+const char* CounterName(Counter counter);
+const char* CounterTimerName(CounterTimer timer);
+
+// Print the summary of every counter & timer over all frames ended.
+void CountersPrintSummary(FILE* file);
+
+#endif//COUNTERS_H
@@ -0,0 +1,129 @@
+#include "curve.h"
+
+extern inline double SampleCurveTable(const double* table, double x);
+extern inline const double* GetCurveTable(ResponseCurve* c);
+extern inline double SampleCurve(ResponseCurve* c, double x);
+extern inline fixed_t SampleCurveTableFx(const fixed_t* table, fixed_t x);
+extern inline const fixed_t* GetCurveTableFx(ResponseCurve* c);
+
+static const char* const curveNames[NUM_CURVE_TYPES] =
+{
+	[CURVE_RATIONAL]  = "rational",
+	[CURVE_POWER]     = "power",
+	[CURVE_PIECEWISE] = "piecewise",
+	[CURVE_BEZIER]    = "bezier"
+};
+
+static const double defaultParams[NUM_CURVE_TYPES] =
+{
+	[CURVE_RATIONAL]  = 1.25,
+	[CURVE_POWER]     = 2.0,
+	[CURVE_PIECEWISE] = 0.5,
+	[CURVE_BEZIER]    = 0.5
+};
+
+
+static void DefaultPoints(ResponseCurve* c)
+{
+	c->numPoints = 3;
+	c->points[0] = (vector){0.0, 0.0};
+	c->points[1] = (vector){0.5, 0.5 * (1.0 - c->param)};
+	c->points[2] = (vector){1.0, 1.0};
+}
+
+void InitCurve(ResponseCurve* c, CurveType type, double param)
+{
+	c->type = type;
+	c->param = param;
+	c->customPoints = false;
+	if (type == CURVE_PIECEWISE)
+		DefaultPoints(c);
+	c->dirty = true;
+}
+
+double DefaultCurveParam(CurveType type)
+{
+	return defaultParams[type];
+}
+
+const char* CurveName(CurveType type)
+{
+	return curveNames[type];
+}
+
+void SetCurveParam(ResponseCurve* c, double param)
+{
+	if (c->param == param)
+		return;
+
+	c->param = param;
+	if (c->type == CURVE_PIECEWISE && !c->customPoints)
+		DefaultPoints(c);
+	c->dirty = true;
+}
+
+void SetCurveTuning(ResponseCurve* c, double t)
+{
+	switch (c->type)
+	{
+	case (CURVE_RATIONAL):  SetCurveParam(c, pow(t * 3, 1.0 + t * 3)); break;
+	case (CURVE_POWER):     SetCurveParam(c, 1.0 + t * 3.0); break;
+	case (CURVE_PIECEWISE): SetCurveParam(c, t * 0.9); break;
+	case (CURVE_BEZIER):    SetCurveParam(c, t); break;
+	default: break;
+	}
+}
+
+void SetCurvePoints(ResponseCurve* c, const vector* points, int num)
+{
+	c->numPoints = CLAMP(num, 2, CURVE_MAX_POINTS);
+	for (int i = 0; i < c->numPoints; ++i)
+		c->points[i] = points[i];
+	c->customPoints = true;
+	c->dirty = true;
+}
+
+
+static double EvalPiecewise(const ResponseCurve* c, double x)
+{
+	int i = 1;
+	while (i < c->numPoints - 1 && x > c->points[i].x)
+		++i;
+
+	const vector a = c->points[i - 1], b = c->points[i];
+	if (b.x <= a.x)
+		return b.y;
+	return a.y + (b.y - a.y) * (x - a.x) / (b.x - a.x);
+}
+
+static double EvalBezier(double k, double x)
+{
+	// Control points (1/3, (1-k)/3) & (2/3, 2(1-k)/3) sit at even thirds
+	// on x, making x(t) = t so the curve can be evaluated directly
+	const double y1 = (1.0 - k) / 3.0, y2 = 2.0 * (1.0 - k) / 3.0;
+	const double it = 1.0 - x;
+	return 3.0 * it * it * x * y1 + 3.0 * it * x * x * y2 + x * x * x;
+}
+
+static double EvalCurve(const ResponseCurve* c, double x)
+{
+	switch (c->type)
+	{
+	case (CURVE_RATIONAL):  return (x * (x + c->param)) / (1.0 + c->param);
+	case (CURVE_POWER):     return pow(x, c->param);
+	case (CURVE_PIECEWISE): return EvalPiecewise(c, x);
+	case (CURVE_BEZIER):    return EvalBezier(c->param, x);
+	default: return x;
+	}
+}
+
+void BakeCurve(ResponseCurve* c)
+{
+	const double step = 1.0 / (double)CURVE_TABLE_SIZE;
+	for (int i = 0; i <= CURVE_TABLE_SIZE; ++i)
+	{
+		c->table[i] = EvalCurve(c, step * (double)i);
+		c->fxtable[i] = FxFromDouble(c->table[i]);
+	}
+	c->dirty = false;
+}
@@ -0,0 +1,107 @@
+#ifndef CURVE_H
+#define CURVE_H
+
+#include "maths.h"
+#include "util.h"
+#include <stdbool.h>
+
+// Number of linear segments in a baked curve table.
+//
+// Linear interpolation error is bounded by max|f''| / (8 * SIZE^2),
+// about 4e-6 for the default rational curve.
+#define CURVE_TABLE_SIZE 256
+#define CURVE_MAX_POINTS 8
+
+typedef enum
+{
+	CURVE_RATIONAL,  // x * (x + k) / (1 + k)
+	CURVE_POWER,     // x ^ k
+	CURVE_PIECEWISE, // Linear interpolation between control points
+	CURVE_BEZIER,    // Cubic Bézier from (0,0) to (1,1), k bends it towards ease-in
+	NUM_CURVE_TYPES
+} CurveType;
+
+// Response curve mapping a stick magnitude in [0, 1] to an output
+// magnitude, evaluated through a lazily rebuilt lookup table.
+typedef struct
+{
+	CurveType type;
+	double param;
+	int numPoints;
+	vector points[CURVE_MAX_POINTS];
+	bool customPoints; // Set by SetCurvePoints, param no longer places the knee
+
+	bool dirty;
+	double table[CURVE_TABLE_SIZE + 1];
+	fixed_t fxtable[CURVE_TABLE_SIZE + 1];
+} ResponseCurve;
+
+// Initialise a curve of the given type & parameter.
+//
+// Piecewise curves get a default knee at (0.5, 0.5 * (1 - k)).
+void InitCurve(ResponseCurve* c, CurveType type, double param);
+
+// Get the default parameter for a curve type.
+double DefaultCurveParam(CurveType type);
+
+// Get a human readable curve type name.
+const char* CurveName(CurveType type);
+
+// Set the curve parameter, only invalidating the table if it changed.
+//
+// Moves the knee of a piecewise curve still on its default points, points
+// given with SetCurvePoints are kept.
+void SetCurveParam(ResponseCurve* c, double param);
+
+// Set the parameter from a normalised 0-1 tuning knob, mapped to a useful
+// range for the curve's type.
+void SetCurveTuning(ResponseCurve* c, double t);
+
+// Replace the control points of a piecewise curve.
+//
+// Points must be sorted by x & span [0, 1], 2 <= num <= CURVE_MAX_POINTS.
+void SetCurvePoints(ResponseCurve* c, const vector* points, int num);
+
+// Rebuild the lookup table, normally called by SampleCurve as needed.
+void BakeCurve(ResponseCurve* c);
+
+// Interpolate a baked table at x, clamped to [0, 1].
+inline double SampleCurveTable(const double* table, double x)
+{
+	const double fx = SATURATE(x) * (double)CURVE_TABLE_SIZE;
+	const int i = MIN((int)fx, CURVE_TABLE_SIZE - 1);
+	return table[i] + (table[i + 1] - table[i]) * (fx - (double)i);
+}
+
+// Get the curve's table, rebuilding it first if out of date.
+inline const double* GetCurveTable(ResponseCurve* c)
+{
+	if (c->dirty)
+		BakeCurve(c);
+	return c->table;
+}
+
+// Evaluate the curve at x, clamped to [0, 1].
+inline double SampleCurve(ResponseCurve* c, double x)
+{
+	return SampleCurveTable(GetCurveTable(c), x);
+}
+
+// Fixed point equivalent of SampleCurveTable.
+inline fixed_t SampleCurveTableFx(const fixed_t* table, fixed_t x)
+{
+	const int32_t fx = CLAMP(x, 0, FX_ONE) * CURVE_TABLE_SIZE;
+	const int i = MIN(fx >> FX_SHIFT, CURVE_TABLE_SIZE - 1);
+	const int32_t frac = fx - (i << FX_SHIFT);
+	return table[i] + (fixed_t)(((int64_t)(table[i + 1] - table[i]) * frac) >> FX_SHIFT);
+}
+
+// Get the curve's fixed point table, rebuilding it first if out of date.
+inline const fixed_t* GetCurveTableFx(ResponseCurve* c)
+{
+	if (c->dirty)
+		BakeCurve(c);
+	return c->fxtable;
+}
+
+#endif//CURVE_H
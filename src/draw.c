@@ -1,111 +1,446 @@
 #include "draw.h"
+#include "draw_backend.h"
+#include "counters.h"
+#include "trace.h"
 #include "maths.h"
+#include "tessellate.h"
 #include <SDL_render.h>
+#include <SDL_version.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+ #define HAVE_RENDER_GEOMETRY
+#endif
 
 static SDL_Renderer* rend = NULL;
 
-void DrawWindowHints(void) {}
+// Layers are render targets covering just their bounds, draw calls are
+// moved by the origin of the one being captured
+#define LAYER_MARGIN 2 // Pixels around the bounds kept for antialiased edges
+static SDL_Texture* layers[MAX_DRAW_LAYERS];
+static rect layerBounds[MAX_DRAW_LAYERS];
+static bool layerValid[MAX_DRAW_LAYERS];
+static bool layerCapture = false;
+static point layerOrigin = {0, 0};
+
+// Scratch polyline for circles & arcs
+static SDL_Point* polyline = NULL;
+static int polylineCap = 0;
+
+// Build antialiased lines out of triangles & submit them in batches
+static bool useGeometry = false;
+
+#ifdef HAVE_RENDER_GEOMETRY
+static SDL_Vertex* geomVerts = NULL;
+static int* geomIndices = NULL;
+static int geomVertNum = 0, geomVertCap = 0, geomIdxNum = 0, geomIdxCap = 0;
+static SDL_Color geomColour = {0, 0, 0, 0};
+
+// Same falloff as the GL core line shaders, in pixels from the line centre
+#define GEOM_INNER 0.5f
+#define GEOM_OUTER 1.25f
+
+static bool Reserve(void** data, int* cap, int need, size_t elemSize)
+{
+	if (need <= *cap)
+		return true;
+	int newCap = MAX(*cap * 2, MAX(need, 256));
+	void* tmp = realloc(*data, (size_t)newCap * elemSize);
+	if (!tmp)
+		return false;
+	*data = tmp;
+	*cap = newCap;
+	return true;
+}
+
+static void FlushGeometry(void)
+{
+	if (!geomIdxNum)
+		return;
+	TRACE_BEGIN("flush");
+	SDL_RenderGeometry(rend, NULL, geomVerts, geomVertNum, geomIndices, geomIdxNum);
+	TRACE_END();
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+	CounterAdd(COUNTER_FLUSHES, 1);
+	CounterAdd(COUNTER_VERTICES, (uint64_t)geomVertNum);
+	CounterAdd(COUNTER_INDICES, (uint64_t)geomIdxNum);
+	geomVertNum = geomIdxNum = 0;
+}
+
+// Append a line as three quads, a solid core between two transparent edges
+static void GeometryLine(float x1, float y1, float x2, float y2)
+{
+	const float dx = x2 - x1, dy = y2 - y1;
+	const float len = sqrtf(dx * dx + dy * dy);
+	if (len <= 0.0f)
+		return;
+	if (!Reserve((void**)&geomVerts, &geomVertCap, geomVertNum + 8, sizeof(SDL_Vertex)) ||
+		!Reserve((void**)&geomIndices, &geomIdxCap, geomIdxNum + 18, sizeof(int)))
+		return;
+
+	const float nx = -dy / len, ny = dx / len;
+	static const float rowOffset[4] = {-GEOM_OUTER, -GEOM_INNER, GEOM_INNER, GEOM_OUTER};
+	const SDL_Color edge = {geomColour.r, geomColour.g, geomColour.b, 0};
+
+	const int base = geomVertNum;
+	for (int i = 0; i < 4; ++i)
+	{
+		const SDL_Color c = (i == 0 || i == 3) ? edge : geomColour;
+		const float o = rowOffset[i];
+		geomVerts[geomVertNum++] = (SDL_Vertex){{x1 + nx * o, y1 + ny * o}, c, {0.0f, 0.0f}};
+		geomVerts[geomVertNum++] = (SDL_Vertex){{x2 + nx * o, y2 + ny * o}, c, {0.0f, 0.0f}};
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		const int a = base + i * 2;
+		geomIndices[geomIdxNum++] = a;
+		geomIndices[geomIdxNum++] = a + 1;
+		geomIndices[geomIdxNum++] = a + 2;
+		geomIndices[geomIdxNum++] = a + 1;
+		geomIndices[geomIdxNum++] = a + 3;
+		geomIndices[geomIdxNum++] = a + 2;
+	}
+}
+#else
+static inline void FlushGeometry(void) {}
+static inline void GeometryLine(float x1, float y1, float x2, float y2) {}
+#endif
+
+// Geometry lines are positioned at pixel centres to match native lines
+static inline void GeometryLineInt(int x1, int y1, int x2, int y2)
+{
+	GeometryLine(
+		(float)x1 + 0.5f, (float)y1 + 0.5f,
+		(float)x2 + 0.5f, (float)y2 + 0.5f);
+}
+
+// Pick the line path, defaulting to triangle batches on the software
+// renderer where the per-command overhead is highest
+static bool UseGeometryLines(void)
+{
+#ifdef HAVE_RENDER_GEOMETRY
+	const char* env = getenv("PADLAB_SDL_LINES");
+	if (env && !strcmp(env, "geometry"))
+		return true;
+	if (env && !strcmp(env, "native"))
+		return false;
+
+	SDL_RendererInfo info;
+	return !SDL_GetRendererInfo(rend, &info) && !strcmp(info.name, "software");
+#else
+	return false;
+#endif
+}
 
-int InitDraw(SDL_Window* window)
+static SDL_Point* ReservePolyline(int count)
+{
+	if (count > polylineCap)
+	{
+		SDL_Point* tmp = realloc(polyline, (size_t)count * sizeof(SDL_Point));
+		if (!tmp)
+			return NULL;
+		polyline = tmp;
+		polylineCap = count;
+	}
+	return polyline;
+}
+
+static void BackendInvalidateDrawLayers(void);
+
+static void BackendWindowHints(void) {}
+
+static int BackendInit(SDL_Window* window)
 {
 	const int rendflags = SDL_RENDERER_PRESENTVSYNC;
 	rend = SDL_CreateRenderer(window, -1, rendflags);
-	return (rend == NULL) ? -1 : 0;
+	if (rend == NULL)
+		return -1;
+
+	useGeometry = UseGeometryLines();
+	if (useGeometry)
+		SDL_SetRenderDrawBlendMode(rend, SDL_BLENDMODE_BLEND);
+	if (getenv("PADLAB_SDL_LINES")) // Confirm overrides, older SDL can't honour "geometry"
+		fprintf(stderr, "Using %s lines\n", useGeometry ? "geometry" : "native");
+	return 0;
 }
 
-void QuitDraw(void)
+static void BackendQuit(void)
 {
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+	{
+		if (layers[i])
+			SDL_DestroyTexture(layers[i]);
+		layers[i] = NULL;
+		layerValid[i] = false;
+	}
+	layerCapture = false;
+	layerOrigin = (point){0, 0};
+	free(polyline);
+	polyline = NULL;
+	polylineCap = 0;
+#ifdef HAVE_RENDER_GEOMETRY
+	free(geomVerts);
+	free(geomIndices);
+	geomVerts = NULL;
+	geomIndices = NULL;
+	geomVertNum = geomVertCap = geomIdxNum = geomIdxCap = 0;
+#endif
 	SDL_DestroyRenderer(rend);
 	rend = NULL;
 }
 
 
-size GetDrawSizeInPixels(void)
+static size BackendGetDrawSize(void)
 {
 	size out = {0, 0};
 	SDL_GetRendererOutputSize(rend, &out.w, &out.h);
 	return out;
 }
 
-void SetDrawViewport(size size) {}
+static void BackendSetDrawViewport(size size)
+{
+	BackendInvalidateDrawLayers();
+}
 
 
-void SetDrawColour(uint32_t c)
+static void BackendSetDrawColour(uint32_t c)
 {
 	SDL_SetRenderDrawColor(rend,
 		(c & 0xFF000000) >> 24,
 		(c & 0x00FF0000) >> 16,
 		(c & 0x0000FF00) >>  8,
 		(c & 0x000000FF));
+#ifdef HAVE_RENDER_GEOMETRY
+	geomColour = (SDL_Color){
+		(Uint8)((c & 0xFF000000) >> 24),
+		(Uint8)((c & 0x00FF0000) >> 16),
+		(Uint8)((c & 0x0000FF00) >>  8),
+		(Uint8)((c & 0x000000FF))};
+#endif
 }
 
-void DrawClear(void)
+static void BackendDrawClear(void)
 {
+#ifdef HAVE_RENDER_GEOMETRY
+	geomVertNum = geomIdxNum = 0; // Anything still pending would be cleared anyway
+#endif
 	SDL_RenderClear(rend);
 }
 
-void DrawPoint(int x, int y)
+static void BackendDrawPoint(int x, int y)
 {
+	x -= layerOrigin.x;
+	y -= layerOrigin.y;
+	if (useGeometry)
+	{
+		GeometryLine((float)x, (float)y + 0.5f, (float)x + 1.0f, (float)y + 0.5f);
+		return;
+	}
 	SDL_RenderDrawPoint(rend, x, y);
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+	CounterAdd(COUNTER_VERTICES, 1);
 }
 
-void DrawRect(int x, int y, int w, int h)
+static void BackendDrawRect(int x, int y, int w, int h)
 {
+	x -= layerOrigin.x;
+	y -= layerOrigin.y;
+	if (useGeometry)
+	{
+		GeometryLineInt(x, y, x + w, y);
+		GeometryLineInt(x + w, y, x + w, y + h);
+		GeometryLineInt(x + w, y + h, x, y + h);
+		GeometryLineInt(x, y + h, x, y);
+		return;
+	}
+
 	SDL_Rect dst = {
 		.x = x, .y = y,
 		.w = w, .h = h };
 	SDL_RenderDrawRect(rend, &dst);
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+	CounterAdd(COUNTER_VERTICES, 4);
 }
 
-void DrawLine(int x1, int y1, int x2, int y2)
+// Draw a circle or arc polyline as a single command, or as geometry lines
+static void DrawPolyline(const SDL_Point* points, int count)
 {
-	SDL_RenderDrawLine(rend, x1, y1, x2, y2);
+	if (useGeometry)
+	{
+		for (int i = 1; i < count; ++i)
+			GeometryLineInt(points[i - 1].x, points[i - 1].y, points[i].x, points[i].y);
+		return;
+	}
+	SDL_RenderDrawLines(rend, points, count);
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+	CounterAdd(COUNTER_VERTICES, (uint64_t)count);
 }
 
-void DrawCircleSteps(int x, int y, int r, int steps)
+static void BackendDrawLines(const point* points, int count)
 {
-	double stepsz = (double)TAU / steps;
-	int lastx = r;
-	int lasty = 0;
-	for (int i = 1; i <= steps; ++i)
-	{
-		const double mag = (double)r;
-		int ofsx = (int)round(cos(stepsz * i) * mag);
-		int ofsy = (int)round(sin(stepsz * i) * mag);
+	SDL_Point* line = count >= 2 ? ReservePolyline(count) : NULL;
+	if (!line)
+		return;
 
-		SDL_RenderDrawLine(rend,
-			x + lastx, y + lasty,
-			x + ofsx, y + ofsy);
+	for (int i = 0; i < count; ++i)
+		line[i] = (SDL_Point){ points[i].x - layerOrigin.x, points[i].y - layerOrigin.y };
+	DrawPolyline(line, count);
+}
 
-		lastx = ofsx;
-		lasty = ofsy;
-	}
+static inline int RoundToInt(float x)
+{
+	return (int)(x < 0.0f ? x - 0.5f : x + 0.5f);
 }
 
-void DrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
+static void BackendDrawCircleSteps(int x, int y, int r, int steps)
 {
-	const double fstart = (double)startAng * DEG2RAD;
-	const double fstepSz = (double)(endAng - startAng) / abs(steps) * DEG2RAD;
-	const double mag = (double)r;
+	const tessvec* unit = GetUnitArc(360, steps);
+	SDL_Point* points = unit ? ReservePolyline(steps + 1) : NULL;
+	if (!points)
+		return;
 
-	int lastx = (int)round(cos(fstart) * mag);
-	int lasty = (int)round(-sin(fstart) * mag);
-	for (int i = 1; i <= steps; ++i)
+	const float mag = (float)r;
+	x -= layerOrigin.x;
+	y -= layerOrigin.y;
+	for (int i = 0; i <= steps; ++i)
+		points[i] = (SDL_Point){x + RoundToInt(unit[i].x * mag), y + RoundToInt(unit[i].y * mag)};
+	DrawPolyline(points, steps + 1);
+}
+
+static void BackendDrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
+{
+	const tessvec* unit = GetUnitArc(endAng - startAng, steps);
+	SDL_Point* points = unit ? ReservePolyline(steps + 1) : NULL;
+	if (!points)
+		return;
+
+	const tessvec dir = GetUnitDirection(startAng);
+	const float mag = (float)r;
+	x -= layerOrigin.x;
+	y -= layerOrigin.y;
+	for (int i = 0; i <= steps; ++i)
 	{
-		const double theta = fstart + fstepSz * (double)i;
-		int ofsx = (int)round(cos(theta) * mag);
-		int ofsy = (int)round(-sin(theta) * mag);
+		const tessvec ofs = TessRotate(unit[i], dir);
+		points[i] = (SDL_Point){x + RoundToInt(ofs.x * mag), y + RoundToInt(ofs.y * mag)};
+	}
+	DrawPolyline(points, steps + 1);
+}
 
-		SDL_RenderDrawLine(rend,
-			x + lastx, y + lasty,
-			x + ofsx, y + ofsy);
+static bool BackendDrawArcAnalytic(int x, int y, int r, int startAng, int endAng)
+{
+	return false;
+}
 
-		lastx = ofsx;
-		lasty = ofsy;
+static SDL_Texture* GetLayerTexture(int layer, size out)
+{
+	SDL_Texture* tex = layers[layer];
+	if (tex)
+	{
+		int w, h;
+		if (!SDL_QueryTexture(tex, NULL, NULL, &w, &h) && w == out.w && h == out.h)
+			return tex;
+		SDL_DestroyTexture(tex);
 	}
+
+	tex = SDL_CreateTexture(rend, SDL_PIXELFORMAT_RGBA8888,
+		SDL_TEXTUREACCESS_TARGET, out.w, out.h);
+	if (tex)
+		SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+	return layers[layer] = tex;
 }
 
-void DrawPresent(void)
+static void BackendBeginDrawLayer(int layer, rect bounds)
 {
+	FlushGeometry();
+
+	// Without render target support draw calls go straight to the screen
+	// and the layer stays invalid, so it's redrawn by the caller each time
+	layerValid[layer] = false;
+	if (!SDL_RenderTargetSupported(rend) || bounds.w <= 0 || bounds.h <= 0)
+		return;
+
+	bounds = (rect){
+		bounds.x - LAYER_MARGIN, bounds.y - LAYER_MARGIN,
+		bounds.w + LAYER_MARGIN * 2, bounds.h + LAYER_MARGIN * 2 };
+	SDL_Texture* tex = GetLayerTexture(layer, (size){bounds.w, bounds.h});
+	if (!tex || SDL_SetRenderTarget(rend, tex))
+		return;
+	layerBounds[layer] = bounds;
+	layerOrigin = (point){bounds.x, bounds.y};
+
+	uint8_t r, g, b, a;
+	SDL_GetRenderDrawColor(rend, &r, &g, &b, &a);
+	SDL_SetRenderDrawColor(rend, 0x00, 0x00, 0x00, 0x00);
+	SDL_RenderClear(rend);
+	SDL_SetRenderDrawColor(rend, r, g, b, a);
+
+	layerValid[layer] = layerCapture = true;
+}
+
+static void BackendEndDrawLayer(void)
+{
+	if (!layerCapture)
+		return;
+	FlushGeometry();
+	SDL_SetRenderTarget(rend, NULL);
+	layerCapture = false;
+	layerOrigin = (point){0, 0};
+}
+
+static void BackendDrawLayer(int layer)
+{
+	if (!layerValid[layer])
+		return;
+	FlushGeometry();
+	const rect* b = &layerBounds[layer];
+	const SDL_Rect dst = { .x = b->x, .y = b->y, .w = b->w, .h = b->h };
+	SDL_RenderCopy(rend, layers[layer], NULL, &dst);
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+}
+
+static bool BackendIsDrawLayerValid(int layer)
+{
+	return layerValid[layer];
+}
+
+static void BackendInvalidateDrawLayers(void)
+{
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+		layerValid[i] = false;
+}
+
+static void BackendDrawPresent(void)
+{
+	FlushGeometry();
+	TRACE_BEGIN("swap");
 	SDL_RenderPresent(rend);
+	TRACE_END();
+	CounterAdd(COUNTER_FLUSHES, 1);
 }
+
+const DrawBackend drawBackendSDL =
+{
+	.name                 = "sdl",
+	.windowFlags          = 0,
+	.windowHints          = BackendWindowHints,
+	.init                 = BackendInit,
+	.quit                 = BackendQuit,
+	.getDrawSize          = BackendGetDrawSize,
+	.setDrawViewport      = BackendSetDrawViewport,
+	.setDrawColour        = BackendSetDrawColour,
+	.drawClear            = BackendDrawClear,
+	.drawPoint            = BackendDrawPoint,
+	.drawRect             = BackendDrawRect,
+	.drawLines            = BackendDrawLines,
+	.drawCircleSteps      = BackendDrawCircleSteps,
+	.drawArcSteps         = BackendDrawArcSteps,
+	.drawArcAnalytic      = BackendDrawArcAnalytic,
+	.beginDrawLayer       = BackendBeginDrawLayer,
+	.endDrawLayer         = BackendEndDrawLayer,
+	.drawLayer            = BackendDrawLayer,
+	.isDrawLayerValid     = BackendIsDrawLayerValid,
+	.invalidateDrawLayers = BackendInvalidateDrawLayers,
+	.drawPresent          = BackendDrawPresent
+};
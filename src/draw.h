@@ -5,9 +5,35 @@
 
 #include "util.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct SDL_Window SDL_Window;
 
+// Get the number of drawing backends built in.
+int GetNumDrawBackends(void);
+
+// Get the name of a built in backend.
+//
+// Returns:
+//   The name, or NULL if idx is out of range.
+const char* GetDrawBackendName(int idx);
+
+// Find a built in backend by name.
+//
+// Returns:
+//   The backend's index, or -1 if there is none by that name.
+int FindDrawBackend(const char* name);
+
+// Get the index of the selected backend.
+int GetDrawBackend(void);
+
+// Select the backend used from the next InitDraw on, the first built in
+// backend is used by default. Call only while uninitialised.
+void SetDrawBackend(int idx);
+
+// Get the SDL_WindowFlags the selected backend needs its window created with.
+uint32_t GetDrawWindowFlags(void);
+
 // Call before window creation to setup backend-specific
 // hints and attributes.
 void DrawWindowHints(void);
@@ -73,6 +99,62 @@ void DrawArc(int x, int y, int r, int startAng, int endAng);
 // Draw an arc with a discrete number of steps.
 void DrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps);
 
+// Draw a circle or arc as an analytic primitive evaluated on the GPU.
+//
+// Used by DrawCircle & DrawArc in place of tessellation where supported,
+// a span of 360 degrees or more draws a full circle.
+//
+// Returns:
+//   true if drawn, false if unsupported by the backend.
+bool DrawArcAnalytic(int x, int y, int r, int startAng, int endAng);
+
+// Width & height of a character cell for DrawString, in units of its scale.
+#define FONT_ADVANCE 6
+#define FONT_HEIGHT  6
+
+// Draw a line of text in a built-in stroke font using the draw colour.
+//
+// Covers digits, letters (drawn uppercase) & a few punctuation marks,
+// other characters are left blank.
+//
+// Params:
+//   x, y  - Top left corner of the text.
+//   scale - Pixels per font grid unit, glyphs are 4 by 6 units.
+//
+// Returns:
+//   Width of the drawn text in pixels.
+int DrawString(int x, int y, int scale, const char* str);
+
+// Maximum number of retained layers.
+#define MAX_DRAW_LAYERS 8
+
+// Begin capturing draw calls into a retained layer.
+//
+// The layer's previous contents are discarded, & everything drawn until
+// EndDrawLayer is recorded instead of drawn. Layers hold static geometry
+// that can then be redrawn each frame with DrawLayer at a lower cost
+// than issuing it again.
+//
+// Params:
+//   layer  - Layer index from 0 to MAX_DRAW_LAYERS - 1.
+//   bounds - Area the layer covers, backends may clip anything drawn outside.
+void BeginDrawLayer(int layer, rect bounds);
+
+// Finish capturing the current layer.
+void EndDrawLayer(void);
+
+// Draw the captured contents of a layer.
+void DrawLayer(int layer);
+
+// Check if a layer holds captured contents.
+//
+// Returns:
+//   false if the layer was never captured or has since been invalidated.
+bool IsDrawLayerValid(int layer);
+
+// Discard the contents of every layer, e.g. after a device reset.
+void InvalidateDrawLayers(void);
+
 // Present the current buffer to the screen.
 void DrawPresent(void);
 
@@ -0,0 +1,59 @@
+#ifndef DRAW_BACKEND_H
+#define DRAW_BACKEND_H
+
+#include "draw.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Entry points of a drawing backend, draw_defer.c records the draw.h calls
+// of a frame & replays them through the selected backend at present.
+// Each behaves as its draw.h counterpart unless noted.
+typedef struct
+{
+	const char* name;     // Name given to --backend
+	uint32_t windowFlags; // SDL_WindowFlags the window must be created with
+
+	void (*windowHints)(void);
+	int (*init)(SDL_Window* window);
+	void (*quit)(void);
+	size (*getDrawSize)(void);
+	void (*setDrawViewport)(size size);
+
+	void (*setDrawColour)(uint32_t c);
+	void (*drawClear)(void);
+	void (*drawPoint)(int x, int y);
+	void (*drawRect)(int x, int y, int w, int h);
+
+	// Draw a connected polyline through 'count' points, each one shared by
+	// the segments either side. A count of 2 draws a single line.
+	void (*drawLines)(const point* points, int count);
+
+	void (*drawCircleSteps)(int x, int y, int r, int steps);
+	void (*drawArcSteps)(int x, int y, int r, int startAng, int endAng, int steps);
+	bool (*drawArcAnalytic)(int x, int y, int r, int startAng, int endAng);
+
+	void (*beginDrawLayer)(int layer, rect bounds);
+	void (*endDrawLayer)(void);
+	void (*drawLayer)(int layer);
+	bool (*isDrawLayerValid)(int layer);
+	void (*invalidateDrawLayers)(void);
+
+	void (*drawPresent)(void);
+} DrawBackend;
+
+// Backends built in, the SDL renderer always is
+extern const DrawBackend drawBackendSDL;
+#ifdef USE_OPENGL_LEGACY
+extern const DrawBackend drawBackendGL;
+#endif
+#ifdef USE_OPENGL_CORE
+extern const DrawBackend drawBackendGLCore;
+#endif
+#ifdef USE_METAL
+extern const DrawBackend drawBackendMetal;
+#endif
+#ifdef USE_SOFTWARE
+extern const DrawBackend drawBackendSoft;
+#endif
+
+#endif//DRAW_BACKEND_H
@@ -1,15 +1,16 @@
 #include "draw.h"
-#include "maths.h"
-#include <stdlib.h>
+#include "tessellate.h"
 
 void DrawCircle(int x, int y, int r)
 {
-	const int steps = (int)(sqrt((double)r) * 8.0);
-	DrawCircleSteps(x, y, r, steps);
+	if (DrawArcAnalytic(x, y, r, 0, 360))
+		return;
+	DrawCircleSteps(x, y, r, TessellationSteps(r, 360));
 }
 
 void DrawArc(int x, int y, int r, int startAng, int endAng)
 {
-	const int steps = (int)(sqrt((double)r) * (double)abs(endAng - startAng) / 360.0 * 8.0);
-	DrawArcSteps(x, y, r, startAng, endAng, steps);
+	if (DrawArcAnalytic(x, y, r, startAng, endAng))
+		return;
+	DrawArcSteps(x, y, r, startAng, endAng, TessellationSteps(r, endAng - startAng));
 }
@@ -0,0 +1,553 @@
+#include "draw.h"
+#include "draw_backend.h"
+#include "counters.h"
+#include "trace.h"
+#include "tessellate.h"
+#include <SDL_video.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How far back a primitive may move to join a batch of its own state
+#define MAX_REORDER_DEPTH 64
+// Pixels added around primitive bounds to cover antialiasing & line width
+#define BOUNDS_MARGIN 2
+
+typedef enum
+{
+	CMD_POINT,
+	CMD_LINE,
+	CMD_RECT,
+	CMD_CIRCLE_STEPS,
+	CMD_ARC_STEPS,
+	CMD_ARC_ANALYTIC,
+	// Barriers, nothing is reordered across these
+	CMD_CLEAR,
+	CMD_BEGIN_LAYER,
+	CMD_END_LAYER,
+	CMD_DRAW_LAYER,
+	CMD_INVALIDATE_LAYERS
+} CmdType;
+
+// Backend state a primitive needs besides its colour, switching between
+// these costs a flush in backends that batch each kind separately
+typedef enum
+{
+	KIND_POINT,
+	KIND_LINE,
+	KIND_ARC
+} CmdKind;
+
+typedef struct
+{
+	uint8_t type, kind;
+	uint32_t colour;
+	int32_t args[6];
+} Cmd;
+
+// Run of primitives with the same colour & kind, drawn together
+typedef struct
+{
+	uint32_t colour;
+	uint8_t kind;
+	int first, last;            // Chain of commands through 'next'
+	int minx, miny, maxx, maxy; // Union of the bounds of its commands
+} Batch;
+
+// Commands are appended to a frame arena that keeps its memory between frames
+static Cmd* cmds = NULL;
+static int cmdNum = 0, cmdCap = 0;
+static int* next = NULL;
+static int nextCap = 0;
+static Batch* batches = NULL;
+static int batchCap = 0;
+static point* strip = NULL;
+static int stripNum = 0, stripCap = 0;
+
+// Built in backends, the first is used unless another is chosen
+static const DrawBackend* const backends[] =
+{
+	&drawBackendSDL,
+#ifdef USE_OPENGL_CORE
+	&drawBackendGLCore,
+#endif
+#ifdef USE_OPENGL_LEGACY
+	&drawBackendGL,
+#endif
+#ifdef USE_METAL
+	&drawBackendMetal,
+#endif
+#ifdef USE_SOFTWARE
+	&drawBackendSoft,
+#endif
+};
+#define NUM_BACKENDS (int)(sizeof(backends) / sizeof(*backends))
+
+static int backendIdx = 0;
+static const DrawBackend* backend = &drawBackendSDL;
+
+static uint32_t colour = 0x00000000;
+static uint32_t backendColour = 0x00000000;
+static bool backendColourValid = false;
+static int layerCapture = -1;
+static bool layerPending[MAX_DRAW_LAYERS];
+static bool layersInvalidated = false; // The backend's layers go stale at replay
+
+static enum { DEFER_UNKNOWN, DEFER_ON, DEFER_OFF } deferMode = DEFER_UNKNOWN;
+
+static bool Reserve(void** data, int* cap, int need, size_t elemSize)
+{
+	if (need <= *cap)
+		return true;
+	int newCap = MAX(*cap * 2, MAX(need, 256));
+	void* tmp = realloc(*data, (size_t)newCap * elemSize);
+	if (!tmp)
+		return false;
+	*data = tmp;
+	*cap = newCap;
+	return true;
+}
+
+// Calls go straight to the backend when PADLAB_DRAW_DEFER is 0, for comparison
+static bool Deferred(void)
+{
+	if (deferMode == DEFER_UNKNOWN)
+	{
+		const char* env = getenv("PADLAB_DRAW_DEFER");
+		deferMode = env && !strcmp(env, "0") ? DEFER_OFF : DEFER_ON;
+	}
+	return deferMode == DEFER_ON;
+}
+
+static void Record(CmdType type, CmdKind kind, int a0, int a1, int a2, int a3, int a4, int a5)
+{
+	if (!Reserve((void**)&cmds, &cmdCap, cmdNum + 1, sizeof(Cmd)))
+		return;
+	cmds[cmdNum++] = (Cmd){(uint8_t)type, (uint8_t)kind, colour, {a0, a1, a2, a3, a4, a5}};
+}
+
+static bool IsBarrier(const Cmd* c)
+{
+	return c->type >= CMD_CLEAR;
+}
+
+
+static void CmdBounds(const Cmd* c, int* minx, int* miny, int* maxx, int* maxy)
+{
+	const int32_t* a = c->args;
+	switch ((CmdType)c->type)
+	{
+	case CMD_POINT:
+		*minx = *maxx = a[0];
+		*miny = *maxy = a[1];
+		break;
+	case CMD_LINE:
+		*minx = MIN(a[0], a[2]); *maxx = MAX(a[0], a[2]);
+		*miny = MIN(a[1], a[3]); *maxy = MAX(a[1], a[3]);
+		break;
+	case CMD_RECT:
+		*minx = MIN(a[0], a[0] + a[2]); *maxx = MAX(a[0], a[0] + a[2]);
+		*miny = MIN(a[1], a[1] + a[3]); *maxy = MAX(a[1], a[1] + a[3]);
+		break;
+	default:
+		*minx = a[0] - a[2]; *maxx = a[0] + a[2];
+		*miny = a[1] - a[2]; *maxy = a[1] + a[2];
+		break;
+	}
+	*minx -= BOUNDS_MARGIN; *miny -= BOUNDS_MARGIN;
+	*maxx += BOUNDS_MARGIN; *maxy += BOUNDS_MARGIN;
+}
+
+// Group the primitives in [begin, end) into batches of the same state.
+//
+// A primitive joins the latest batch of its state unless it would move in
+// front of an overlapping primitive of another colour. Blending the same
+// colour commutes, so only colour differences can make order matter.
+//
+// Returns:
+//   Number of batches, or -1 if out of memory.
+static int BuildBatches(int begin, int end)
+{
+	if (!Reserve((void**)&batches, &batchCap, end - begin, sizeof(Batch)) ||
+		!Reserve((void**)&next, &nextCap, cmdNum, sizeof(int)))
+		return -1;
+
+	int num = 0;
+	for (int i = begin; i < end; ++i)
+	{
+		const Cmd* c = &cmds[i];
+		int minx, miny, maxx, maxy;
+		CmdBounds(c, &minx, &miny, &maxx, &maxy);
+
+		int target = -1;
+		for (int j = num - 1; j >= 0 && j >= num - MAX_REORDER_DEPTH; --j)
+		{
+			const Batch* b = &batches[j];
+			if (b->colour == c->colour && b->kind == c->kind)
+			{
+				target = j;
+				break;
+			}
+			if (b->colour != c->colour &&
+				b->minx <= maxx && minx <= b->maxx && b->miny <= maxy && miny <= b->maxy)
+				break;
+		}
+
+		next[i] = -1;
+		if (target < 0)
+		{
+			batches[num++] = (Batch){c->colour, c->kind, i, i, minx, miny, maxx, maxy};
+			continue;
+		}
+		Batch* b = &batches[target];
+		next[b->last] = i;
+		b->last = i;
+		b->minx = MIN(b->minx, minx); b->miny = MIN(b->miny, miny);
+		b->maxx = MAX(b->maxx, maxx); b->maxy = MAX(b->maxy, maxy);
+	}
+	return num;
+}
+
+
+static void FlushStrip(void)
+{
+	if (stripNum >= 2)
+		backend->drawLines(strip, stripNum);
+	stripNum = 0;
+}
+
+static bool SamePoint(point a, point b)
+{
+	return a.x == b.x && a.y == b.y;
+}
+
+// Chain a line onto the current strip when it continues from either end
+static void StripLine(point from, point to)
+{
+	if (stripNum && SamePoint(strip[stripNum - 1], to))
+	{
+		const point tmp = from;
+		from = to;
+		to = tmp;
+	}
+	if (!stripNum || !SamePoint(strip[stripNum - 1], from))
+	{
+		FlushStrip();
+		strip[stripNum++] = from;
+	}
+	else if (SamePoint(from, to))
+	{
+		return; // Adds nothing to the strip it touches
+	}
+	strip[stripNum++] = to;
+}
+
+static void Replay(const Cmd* c)
+{
+	const int32_t* a = c->args;
+	switch ((CmdType)c->type)
+	{
+	case CMD_POINT:
+		backend->drawPoint(a[0], a[1]);
+		break;
+	case CMD_LINE:
+		if (Reserve((void**)&strip, &stripCap, stripNum + 2, sizeof(point)))
+			StripLine((point){a[0], a[1]}, (point){a[2], a[3]});
+		break;
+	case CMD_RECT:
+		backend->drawRect(a[0], a[1], a[2], a[3]);
+		break;
+	case CMD_CIRCLE_STEPS:
+		backend->drawCircleSteps(a[0], a[1], a[2], a[3]);
+		break;
+	case CMD_ARC_STEPS:
+		backend->drawArcSteps(a[0], a[1], a[2], a[3], a[4], a[5]);
+		break;
+	case CMD_ARC_ANALYTIC:
+		if (!backend->drawArcAnalytic(a[0], a[1], a[2], a[3], a[4]))
+			backend->drawArcSteps(a[0], a[1], a[2], a[3], a[4], TessellationSteps(a[2], a[4] - a[3]));
+		break;
+	case CMD_CLEAR:
+		backend->drawClear();
+		break;
+	case CMD_BEGIN_LAYER:
+		backend->beginDrawLayer(a[0], (rect){a[1], a[2], a[3], a[4]});
+		break;
+	case CMD_END_LAYER:
+		backend->endDrawLayer();
+		break;
+	case CMD_DRAW_LAYER:
+		backend->drawLayer(a[0]);
+		break;
+	case CMD_INVALIDATE_LAYERS:
+		backend->invalidateDrawLayers();
+		break;
+	}
+}
+
+// Pass a colour on to the backend only when it differs from the last
+static void SetBackendColour(uint32_t c)
+{
+	if (backendColourValid && backendColour == c)
+		return;
+	backend->setDrawColour(c);
+	CounterAdd(COUNTER_COLOUR_CHANGES, 1);
+	backendColour = c;
+	backendColourValid = true;
+}
+
+static void ReplayFrame(void)
+{
+	for (int begin = 0; begin < cmdNum; )
+	{
+		if (IsBarrier(&cmds[begin]))
+		{
+			SetBackendColour(cmds[begin].colour);
+			Replay(&cmds[begin++]);
+			continue;
+		}
+
+		int end = begin;
+		while (end < cmdNum && !IsBarrier(&cmds[end]))
+			++end;
+
+		const int numBatches = BuildBatches(begin, end);
+		if (numBatches < 0)
+		{
+			// Out of memory, replay as recorded
+			for (int i = begin; i < end; ++i)
+			{
+				SetBackendColour(cmds[i].colour);
+				Replay(&cmds[i]);
+				FlushStrip();
+			}
+		}
+		for (int j = 0; j < numBatches; ++j)
+		{
+			const Batch* b = &batches[j];
+			SetBackendColour(b->colour);
+			for (int i = b->first; i >= 0; i = next[i])
+				Replay(&cmds[i]);
+			FlushStrip();
+		}
+		begin = end;
+	}
+	cmdNum = 0;
+}
+
+
+// Drop anything recorded for the previous backend
+static void ResetFrame(void)
+{
+	cmdNum = 0;
+	layerCapture = -1;
+	backendColourValid = false;
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+		layerPending[i] = false;
+	layersInvalidated = false;
+}
+
+int GetNumDrawBackends(void)
+{
+	return NUM_BACKENDS;
+}
+
+const char* GetDrawBackendName(int idx)
+{
+	return (idx >= 0 && idx < NUM_BACKENDS) ? backends[idx]->name : NULL;
+}
+
+int FindDrawBackend(const char* name)
+{
+	for (int i = 0; i < NUM_BACKENDS; ++i)
+		if (!strcmp(backends[i]->name, name))
+			return i;
+	return -1;
+}
+
+int GetDrawBackend(void)
+{
+	return backendIdx;
+}
+
+void SetDrawBackend(int idx)
+{
+	backendIdx = CLAMP(idx, 0, NUM_BACKENDS - 1);
+	backend = backends[backendIdx];
+}
+
+uint32_t GetDrawWindowFlags(void)
+{
+	return backend->windowFlags;
+}
+
+void DrawWindowHints(void)
+{
+	// GL attributes are global, so don't carry over another backend's
+	SDL_GL_ResetAttributes();
+	backend->windowHints();
+}
+
+int InitDraw(SDL_Window* window)
+{
+	ResetFrame();
+	return backend->init(window);
+}
+
+void QuitDraw(void)
+{
+	backend->quit();
+	ResetFrame();
+}
+
+size GetDrawSizeInPixels(void)
+{
+	return backend->getDrawSize();
+}
+
+void SetDrawViewport(size size)
+{
+	backend->setDrawViewport(size);
+}
+
+void SetDrawColour(uint32_t c)
+{
+	colour = c;
+	if (!Deferred())
+		SetBackendColour(c);
+}
+
+void DrawClear(void)
+{
+	if (!Deferred())
+	{
+		backend->drawClear();
+		return;
+	}
+
+	// Primitives since the last barrier would be cleared anyway
+	if (layerCapture < 0)
+		while (cmdNum && !IsBarrier(&cmds[cmdNum - 1]))
+			--cmdNum;
+	Record(CMD_CLEAR, KIND_POINT, 0, 0, 0, 0, 0, 0);
+}
+
+void DrawPoint(int x, int y)
+{
+	if (Deferred())
+		Record(CMD_POINT, KIND_POINT, x, y, 0, 0, 0, 0);
+	else
+		backend->drawPoint(x, y);
+}
+
+void DrawRect(int x, int y, int w, int h)
+{
+	if (Deferred())
+		Record(CMD_RECT, KIND_LINE, x, y, w, h, 0, 0);
+	else
+		backend->drawRect(x, y, w, h);
+}
+
+void DrawLine(int x1, int y1, int x2, int y2)
+{
+	if (Deferred())
+		Record(CMD_LINE, KIND_LINE, x1, y1, x2, y2, 0, 0);
+	else
+		backend->drawLines((const point[]){{x1, y1}, {x2, y2}}, 2);
+}
+
+void DrawCircleSteps(int x, int y, int r, int steps)
+{
+	if (Deferred())
+		Record(CMD_CIRCLE_STEPS, KIND_LINE, x, y, r, steps, 0, 0);
+	else
+		backend->drawCircleSteps(x, y, r, steps);
+}
+
+void DrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
+{
+	if (Deferred())
+		Record(CMD_ARC_STEPS, KIND_LINE, x, y, r, startAng, endAng, steps);
+	else
+		backend->drawArcSteps(x, y, r, startAng, endAng, steps);
+}
+
+bool DrawArcAnalytic(int x, int y, int r, int startAng, int endAng)
+{
+	// Backends that turn it down at replay get the tessellated fallback
+	if (!Deferred())
+		return backend->drawArcAnalytic(x, y, r, startAng, endAng);
+	Record(CMD_ARC_ANALYTIC, KIND_ARC, x, y, r, startAng, endAng, 0);
+	return true;
+}
+
+void BeginDrawLayer(int layer, rect bounds)
+{
+	if (!Deferred())
+	{
+		backend->beginDrawLayer(layer, bounds);
+		return;
+	}
+	Record(CMD_BEGIN_LAYER, KIND_POINT, layer, bounds.x, bounds.y, bounds.w, bounds.h, 0);
+	layerCapture = layer;
+}
+
+void EndDrawLayer(void)
+{
+	if (!Deferred())
+	{
+		backend->endDrawLayer();
+		return;
+	}
+	if (layerCapture < 0)
+		return;
+	Record(CMD_END_LAYER, KIND_POINT, 0, 0, 0, 0, 0, 0);
+	layerPending[layerCapture] = true;
+	layerCapture = -1;
+}
+
+void DrawLayer(int layer)
+{
+	if (Deferred())
+		Record(CMD_DRAW_LAYER, KIND_POINT, layer, 0, 0, 0, 0, 0);
+	else
+		backend->drawLayer(layer);
+}
+
+bool IsDrawLayerValid(int layer)
+{
+	// Captures recorded this frame are assumed to succeed when replayed,
+	// & the backend's own are gone once a recorded invalidate replays
+	if (!Deferred())
+		return backend->isDrawLayerValid(layer);
+	return layerPending[layer] || (!layersInvalidated && backend->isDrawLayerValid(layer));
+}
+
+void InvalidateDrawLayers(void)
+{
+	if (!Deferred())
+	{
+		backend->invalidateDrawLayers();
+		return;
+	}
+	Record(CMD_INVALIDATE_LAYERS, KIND_POINT, 0, 0, 0, 0, 0, 0);
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+		layerPending[i] = false;
+	layersInvalidated = true;
+}
+
+void DrawPresent(void)
+{
+	if (Deferred())
+	{
+		if (layerCapture >= 0)
+			EndDrawLayer();
+		TRACE_BEGIN("replay");
+		ReplayFrame();
+		TRACE_END();
+		for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+			layerPending[i] = false;
+		layersInvalidated = false;
+		SetBackendColour(colour);
+	}
+	backend->drawPresent();
+}
@@ -0,0 +1,78 @@
+#include "draw.h"
+#include <ctype.h>
+#include <stddef.h>
+
+// Glyphs are polylines on a 4x6 grid (y down), as pairs of grid digits
+// with a comma lifting the pen between strokes.
+static const char* const glyphs[128] =
+{
+	['0'] = "0040460600,0640",
+	['1'] = "102026,1636",
+	['2'] = "004043030646",
+	['3'] = "00404606,1343",
+	['4'] = "000343,4046",
+	['5'] = "400003434606",
+	['6'] = "400006464303",
+	['7'] = "004046",
+	['8'] = "0040460600,0343",
+	['9'] = "430300404606",
+	['A'] = "0602204246,0343",
+	['B'] = "06003041423344453606,0333",
+	['C'] = "40000646",
+	['D'] = "00304145360600",
+	['E'] = "40000646,0333",
+	['F'] = "400006,0333",
+	['G'] = "400006464323",
+	['H'] = "0006,4046,0343",
+	['I'] = "1030,2026,1636",
+	['J'] = "40460604",
+	['K'] = "0006,400346",
+	['L'] = "000646",
+	['M'] = "0600234046",
+	['N'] = "06004640",
+	['O'] = "0040460600",
+	['P'] = "0600404303",
+	['Q'] = "0040460600,2446",
+	['R'] = "060040430346",
+	['S'] = "400003434606",
+	['T'] = "0040,2026",
+	['U'] = "00064640",
+	['V'] = "002640",
+	['W'] = "0016233640",
+	['X'] = "0046,4006",
+	['Y'] = "002340,2326",
+	['Z'] = "00400646",
+	['.'] = "2526",
+	[':'] = "2122,2425",
+	['-'] = "1333",
+	['/'] = "0640",
+	['%'] = "0640,0001,4546",
+};
+
+int DrawString(int x, int y, int scale, const char* str)
+{
+	const int start = x;
+	for (; *str; ++str)
+	{
+		const unsigned char c = (unsigned char)toupper((unsigned char)*str);
+		const char* glyph = c < 128 ? glyphs[c] : NULL;
+		for (int px = -1, py = -1; glyph && *glyph; )
+		{
+			if (*glyph == ',')
+			{
+				px = py = -1;
+				++glyph;
+				continue;
+			}
+			const int gx = x + (glyph[0] - '0') * scale;
+			const int gy = y + (glyph[1] - '0') * scale;
+			if (px >= 0)
+				DrawLine(px, py, gx, gy);
+			px = gx;
+			py = gy;
+			glyph += 2;
+		}
+		x += FONT_ADVANCE * scale;
+	}
+	return x - start;
+}
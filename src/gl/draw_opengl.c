@@ -1,18 +1,39 @@
 #include "draw.h"
+#include "draw_backend.h"
+#include "counters.h"
+#include "trace.h"
 #include "maths.h"
+#include "tessellate.h"
 #include <SDL_video.h>
 #include <SDL_opengl.h>
 #include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct { GLfloat x, y; GLubyte colour[4]; } vertex;
 
 static SDL_GLContext* ctx = NULL;
 static SDL_Window* window = NULL;
 static uint32_t colour    = 0x00000000;
 static uint32_t clrColour = 0x00000000;
-static double scaleWidth  = 0.0;
-static double scaleHeight = 0.0;
+static GLubyte vertColour[4] = {0, 0, 0, 0};
 static bool antialias     = false;
 
-void DrawWindowHints(void)
+// Primitives are collected into a client-side vertex array & submitted with
+// glDrawArrays, the batch is flushed when switching primitive mode
+static vertex* drawList = NULL;
+static GLsizei drawListNum = 0, drawListCap = 0;
+static GLenum drawListMode = GL_LINES;
+
+// Retained layers are compiled into display lists
+static GLuint layerLists = 0;
+static bool layerValid[MAX_DRAW_LAYERS];
+static int layerCapture = -1;
+
+static size BackendGetDrawSize(void);
+static void BackendSetDrawViewport(size size);
+static void BackendInvalidateDrawLayers(void);
+
+static void BackendWindowHints(void)
 {
 	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1); // Enable MSAA
 	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 8); // 8x MSAA
@@ -23,7 +44,7 @@ void DrawWindowHints(void)
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_COMPATIBILITY);
 }
 
-int InitDraw(SDL_Window* w)
+static int BackendInit(SDL_Window* w)
 {
 	ctx = SDL_GL_CreateContext(w);
 	window = w;
@@ -33,6 +54,7 @@ int InitDraw(SDL_Window* w)
 	SDL_GL_SetSwapInterval(1); // Enable vsync
 
 	// Detect if MSAA is available & active
+	antialias = false;
 	int res;
 	if (SDL_GL_GetAttribute(SDL_GL_MULTISAMPLEBUFFERS, &res) == 0 && res == 1)
 		if (SDL_GL_GetAttribute(SDL_GL_MULTISAMPLESAMPLES, &res) == 0 && res > 0)
@@ -43,49 +65,123 @@ int InitDraw(SDL_Window* w)
 	glDisable(GL_CULL_FACE);
 	glEnable(GL_MULTISAMPLE);
 
-	SetDrawViewport(GetDrawSizeInPixels()); // Fills scaleWidth & scaleHeight
-
 	glLineWidth(2.0f);
 
-	// Setup orthographic viewport
-	glMatrixMode(GL_PROJECTION);
-	glOrtho(0.0, 1.0f, 1.0f, 0.0, 1.0, -1.0);
+	// Setup pixel space orthographic viewport
+	BackendSetDrawViewport(BackendGetDrawSize());
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 
+	// Draw list arrays
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+
+	layerLists = glGenLists(MAX_DRAW_LAYERS);
+	if (layerLists == 0)
+		return -1;
+
 	return 0;
 }
 
-void QuitDraw(void)
+static void BackendQuit(void)
 {
+	if (layerLists)
+		glDeleteLists(layerLists, MAX_DRAW_LAYERS);
+	layerLists = 0;
+	BackendInvalidateDrawLayers();
+
+	free(drawList);
+	drawList = NULL;
+	drawListNum = drawListCap = 0;
+
 	SDL_GL_DeleteContext(ctx);
 	ctx = NULL;
 	window = NULL;
+
+	// A new context starts with a zero clear colour, so forget the cached one
+	colour = clrColour = 0x00000000;
 }
 
 
-size GetDrawSizeInPixels(void)
+static size BackendGetDrawSize(void)
 {
 	size out;
 	SDL_GL_GetDrawableSize(SDL_GL_GetCurrentWindow(), &out.w, &out.h);
 	return out;
 }
 
-void SetDrawViewport(size size)
+static void BackendSetDrawViewport(size size)
 {
 	glViewport(0, 0, size.w, size.h);
-	scaleWidth  = 1.0 / (double)size.w;
-	scaleHeight = 1.0 / (double)size.h;
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0.0, (GLdouble)size.w, (GLdouble)size.h, 0.0, 1.0, -1.0);
+	glMatrixMode(GL_MODELVIEW);
+}
+
+
+static void FlushDrawList(void)
+{
+	if (!drawListNum)
+		return;
+
+	TRACE_BEGIN("flush");
+	glVertexPointer(2, GL_FLOAT, sizeof(vertex), &drawList[0].x);
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(vertex), drawList[0].colour);
+	glDrawArrays(drawListMode, 0, drawListNum);
+	TRACE_END();
+
+	CounterAdd(COUNTER_VERTICES, (uint64_t)drawListNum);
+	drawListNum = 0;
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+	CounterAdd(COUNTER_FLUSHES, 1);
+}
+
+// Make room for 'count' more vertices of a primitive mode
+//
+// Returns:
+//   Pointer to write the vertices to, or NULL if out of memory.
+static vertex* ReserveVertices(GLenum mode, GLsizei count)
+{
+	if (mode != drawListMode)
+	{
+		FlushDrawList();
+		drawListMode = mode;
+	}
+
+	if (drawListNum + count > drawListCap)
+	{
+		GLsizei newCap = MAX(drawListCap * 2, MAX(drawListNum + count, 256));
+		vertex* tmp = realloc(drawList, (size_t)newCap * sizeof(vertex));
+		if (!tmp)
+			return NULL;
+		drawList = tmp;
+		drawListCap = newCap;
+	}
+
+	vertex* out = &drawList[drawListNum];
+	drawListNum += count;
+	return out;
+}
+
+static inline vertex MakeVertex(GLfloat x, GLfloat y)
+{
+	return (vertex){x, y, {vertColour[0], vertColour[1], vertColour[2], vertColour[3]}};
 }
 
 
-void SetDrawColour(uint32_t c)
+static void BackendSetDrawColour(uint32_t c)
 {
 	colour = c;
+	vertColour[0] = (GLubyte)((c & 0xFF000000) >> 24);
+	vertColour[1] = (GLubyte)((c & 0x00FF0000) >> 16);
+	vertColour[2] = (GLubyte)((c & 0x0000FF00) >>  8);
+	vertColour[3] = (GLubyte)((c & 0x000000FF));
 }
 
-void DrawClear(void)
+static void BackendDrawClear(void)
 {
+	drawListNum = 0; // Anything still pending would be cleared anyway
 	if (clrColour != colour)
 	{
 		const float mul = 1.0f / 255.0f;
@@ -99,104 +195,165 @@ void DrawClear(void)
 	glClear(GL_COLOR_BUFFER_BIT);
 }
 
-static inline void GlColour(void)
+static void BackendDrawPoint(int x, int y)
 {
-	const float mul = 1.0f / 255.0f;
-	glColor4f(
-		(GLclampf)((colour & 0xFF000000) >> 24) * mul,
-		(GLclampf)((colour & 0x00FF0000) >> 16) * mul,
-		(GLclampf)((colour & 0x0000FF00) >>  8) * mul,
-		(GLclampf)((colour & 0x000000FF)) * mul);
+	vertex* v = ReserveVertices(GL_POINTS, 1);
+	if (v)
+		v[0] = MakeVertex((GLfloat)x, (GLfloat)y);
 }
 
-void DrawPoint(int x, int y)
+static void BackendDrawRect(int x, int y, int w, int h)
 {
-	const double fx = ((double)x) * scaleWidth;
-	const double fy = ((double)y) * scaleHeight;
-
-	glBegin(GL_POINTS);
-		GlColour();
-		glVertex2d(fx, fy);
-	glEnd();
+	vertex* v = ReserveVertices(GL_LINES, 8);
+	if (!v)
+		return;
+
+	const vertex
+		v00 = MakeVertex((GLfloat)x, (GLfloat)y),
+		v10 = MakeVertex((GLfloat)(x + w), (GLfloat)y),
+		v11 = MakeVertex((GLfloat)(x + w), (GLfloat)(y + h)),
+		v01 = MakeVertex((GLfloat)x, (GLfloat)(y + h));
+	v[0] = v00; v[1] = v10;
+	v[2] = v10; v[3] = v11;
+	v[4] = v11; v[5] = v01;
+	v[6] = v01; v[7] = v00;
 }
 
-void DrawRect(int x, int y, int w, int h)
+static void BackendDrawLines(const point* points, int count)
 {
-	const double fx = (double)x * scaleWidth;
-	const double fy = (double)y * scaleHeight;
-	const double fw = (double)w * scaleWidth;
-	const double fh = (double)h * scaleHeight;
+	vertex* v = count >= 2 ? ReserveVertices(GL_LINES, (count - 1) * 2) : NULL;
+	if (!v)
+		return;
 
-	glBegin(GL_LINE_LOOP);
-		GlColour();
-		glVertex2d(fx, fy);
-		glVertex2d(fx + fw, fy);
-		glVertex2d(fx + fw, fy + fh);
-		glVertex2d(fx, fy + fh);
-	glEnd();
+	vertex last = MakeVertex((GLfloat)points[0].x, (GLfloat)points[0].y);
+	for (int i = 1; i < count; ++i)
+	{
+		const vertex next = MakeVertex((GLfloat)points[i].x, (GLfloat)points[i].y);
+		*v++ = last;
+		*v++ = next;
+		last = next;
+	}
 }
 
-void DrawLine(int x1, int y1, int x2, int y2)
+static void BackendDrawCircleSteps(int x, int y, int r, int steps)
 {
-	const double fx1 = (double)x1 * scaleWidth;
-	const double fy1 = (double)y1 * scaleHeight;
-	const double fx2 = (double)x2 * scaleWidth;
-	const double fy2 = (double)y2 * scaleHeight;
+	const tessvec* unit = GetUnitArc(360, steps);
+	vertex* v = unit ? ReserveVertices(GL_LINES, steps * 2) : NULL;
+	if (!v)
+		return;
+
+	// Circles look better when offset negatively by half a pixel w/o MSAA
+	const GLfloat fx = antialias ? (GLfloat)x : (GLfloat)x - 0.5f;
+	const GLfloat fy = antialias ? (GLfloat)y : (GLfloat)y - 0.5f;
+	const GLfloat mag = (GLfloat)r;
 
-	glBegin(GL_LINES);
-		GlColour();
-		glVertex2d(fx1, fy1);
-		glVertex2d(fx2, fy2);
-	glEnd();
+	vertex last = MakeVertex(fx + unit[0].x * mag, fy + unit[0].y * mag);
+	for (int i = 1; i <= steps; ++i)
+	{
+		const vertex next = MakeVertex(fx + unit[i].x * mag, fy + unit[i].y * mag);
+		*v++ = last;
+		*v++ = next;
+		last = next;
+	}
 }
 
-void DrawCircleSteps(int x, int y, int r, int steps)
+static void BackendDrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
 {
-	// Circles look better when offset negatively by half a pixel w/o MSAA
-	const double fx = (antialias ? (double)x : (double)x - 0.5f) * scaleWidth;
-	const double fy = (antialias ? (double)y : (double)y - 0.5f) * scaleHeight;
+	const tessvec* unit = GetUnitArc(endAng - startAng, steps);
+	vertex* v = unit ? ReserveVertices(GL_LINES, steps * 2) : NULL;
+	if (!v)
+		return;
 
-	const double stepsz = (double)TAU / (double)steps;
-	const double magw   = (double)r * scaleWidth;
-	const double magh   = (double)r * scaleHeight;
-
-	glBegin(GL_LINE_LOOP);
-		GlColour();
-		glVertex2d(fx + magw, fy);
-	for (int i = 1; i < steps; ++i)
+	// Arcs look better when offset negatively by half a pixel w/o MSAA
+	const GLfloat fx = antialias ? (GLfloat)x : (GLfloat)x - 0.5f;
+	const GLfloat fy = antialias ? (GLfloat)y : (GLfloat)y - 0.5f;
+	const GLfloat mag = (GLfloat)r;
+
+	const tessvec dir = GetUnitDirection(startAng);
+	tessvec ofs = TessRotate(unit[0], dir);
+	vertex last = MakeVertex(fx + ofs.x * mag, fy + ofs.y * mag);
+	for (int i = 1; i <= steps; ++i)
 	{
-		const double theta = stepsz * (double)i;
-		double ofsx = cos(theta) * magw;
-		double ofsy = sin(theta) * magh;
-		glVertex2d(fx + ofsx, fy - ofsy);
+		ofs = TessRotate(unit[i], dir);
+		const vertex next = MakeVertex(fx + ofs.x * mag, fy + ofs.y * mag);
+		*v++ = last;
+		*v++ = next;
+		last = next;
 	}
-	glEnd();
 }
 
-void DrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
+static bool BackendDrawArcAnalytic(int x, int y, int r, int startAng, int endAng)
 {
-	// Arcs look better when offset negatively by half a pixel w/o MSAA
-	const double fx = (antialias ? (double)x : (double)x - 0.5f) * scaleWidth;
-	const double fy = (antialias ? (double)y : (double)y - 0.5f) * scaleHeight;
+	return false;
+}
+
+static void BackendBeginDrawLayer(int layer, rect bounds)
+{
+	FlushDrawList();
+	glNewList(layerLists + (GLuint)layer, GL_COMPILE);
+	layerValid[layer] = false;
+	layerCapture = layer;
+}
 
-	const double magw   = (double)r * scaleWidth;
-	const double magh   = (double)r * scaleHeight;
+static void BackendEndDrawLayer(void)
+{
+	if (layerCapture < 0)
+		return;
+	FlushDrawList(); // Vertex arrays are copied into the list when compiled
+	glEndList();
+	layerValid[layerCapture] = true;
+	layerCapture = -1;
+}
 
-	glBegin(GL_LINE_STRIP);
-		GlColour();
-	const double fstart = (double)startAng * DEG2RAD;
-	const double fstepSz = (double)(endAng - startAng) / abs(steps) * DEG2RAD;
-	for (int i = 0; i <= steps; ++i)
-	{
-		const double theta = fstart + fstepSz * (double)i;
-		double ofsx = cos(theta) * magw;
-		double ofsy = sin(theta) * magh;
-		glVertex2d(fx + ofsx, fy - ofsy);
-	}
-	glEnd();
+static void BackendDrawLayer(int layer)
+{
+	if (!layerValid[layer])
+		return;
+	FlushDrawList();
+	glCallList(layerLists + (GLuint)layer);
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
 }
 
-void DrawPresent(void)
+static bool BackendIsDrawLayerValid(int layer)
 {
+	return layerValid[layer];
+}
+
+static void BackendInvalidateDrawLayers(void)
+{
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+		layerValid[i] = false;
+}
+
+static void BackendDrawPresent(void)
+{
+	FlushDrawList();
+	TRACE_BEGIN("swap");
 	SDL_GL_SwapWindow(window);
+	TRACE_END();
 }
+
+const DrawBackend drawBackendGL =
+{
+	.name                 = "gl",
+	.windowFlags          = SDL_WINDOW_OPENGL,
+	.windowHints          = BackendWindowHints,
+	.init                 = BackendInit,
+	.quit                 = BackendQuit,
+	.getDrawSize          = BackendGetDrawSize,
+	.setDrawViewport      = BackendSetDrawViewport,
+	.setDrawColour        = BackendSetDrawColour,
+	.drawClear            = BackendDrawClear,
+	.drawPoint            = BackendDrawPoint,
+	.drawRect             = BackendDrawRect,
+	.drawLines            = BackendDrawLines,
+	.drawCircleSteps      = BackendDrawCircleSteps,
+	.drawArcSteps         = BackendDrawArcSteps,
+	.drawArcAnalytic      = BackendDrawArcAnalytic,
+	.beginDrawLayer       = BackendBeginDrawLayer,
+	.endDrawLayer         = BackendEndDrawLayer,
+	.drawLayer            = BackendDrawLayer,
+	.isDrawLayerValid     = BackendIsDrawLayerValid,
+	.invalidateDrawLayers = BackendInvalidateDrawLayers,
+	.drawPresent          = BackendDrawPresent
+};
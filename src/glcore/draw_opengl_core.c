@@ -1,17 +1,57 @@
 #include "draw.h"
+#include "draw_backend.h"
+#include "counters.h"
+#include "trace.h"
 #include "glslShaders.h"
 #include "maths.h"
+#include "tessellate.h"
 #include <GL/gl3w.h>
 #include <SDL_video.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+ #include <io.h>
+ #include <fcntl.h>
+#else
+ #include <unistd.h>
+#endif
 
-typedef struct { float x, y; } vertex;
+// Colour is packed as RGBA8 in memory order, see PackColour
+typedef struct { float x, y; uint32_t colour; } vertex;
 
-enum { ATTRIB_VERTPOS, NUM_ATTRIBS };
+enum { ATTRIB_VERTPOS, ATTRIB_VERTCOLOUR, NUM_ATTRIBS };
 static const char* const attribNames[] =
 {
-	[ATTRIB_VERTPOS] = "inPos"
+	[ATTRIB_VERTPOS]    = "inPos",
+	[ATTRIB_VERTCOLOUR] = "inColour"
+};
+
+// Instanced lines are uploaded as segments, one per instance
+typedef struct { vertex from, to; } segment;
+
+enum { ATTRIB_LINEFROM, ATTRIB_LINETO, ATTRIB_LINEFROMCOLOUR, ATTRIB_LINETOCOLOUR, NUM_LINE_ATTRIBS };
+static const char* const lineAttribNames[] =
+{
+	[ATTRIB_LINEFROM]       = "inFrom",
+	[ATTRIB_LINETO]         = "inTo",
+	[ATTRIB_LINEFROMCOLOUR] = "inFromColour",
+	[ATTRIB_LINETOCOLOUR]   = "inToColour"
+};
+
+// Analytic circles & arcs are drawn as one instanced quad each
+typedef struct { float x, y, r, start, span; uint32_t colour; } arc;
+
+enum { ATTRIB_ARCCIRCLE, ATTRIB_ARCANGLES, ATTRIB_ARCCOLOUR, NUM_ARC_ATTRIBS };
+static const char* const arcAttribNames[] =
+{
+	[ATTRIB_ARCCIRCLE] = "inCircle",
+	[ATTRIB_ARCANGLES] = "inAngles",
+	[ATTRIB_ARCCOLOUR] = "inColour"
 };
 
 
@@ -22,22 +62,66 @@ static SDL_GLContext* ctx = NULL;
 static SDL_Window* window = NULL;
 static uint32_t
 	colour     = 0x00000000,
-	drawColour = 0x00000000,
+	vertColour = 0x00000000,
 	clrColour  = 0x00000000;
 
-#define DRAWLIST_MAX_SIZE 480
-static vertex drawListVerts[DRAWLIST_MAX_SIZE];
-static uint16_t drawListIndices[DRAWLIST_MAX_SIZE];
-static uint16_t drawListCount = 0, drawListVertNum = 0;
-static GLuint vao = 0, drawListVbo = 0, drawListIbo = 0;
+// Geometry is batched in growable client-side arrays until a layer boundary
+// or present, then streamed into GPU ring buffers
+static vertex* drawListVerts = NULL;
+static uint32_t* drawListIndices = NULL;
+static GLsizei drawListCount = 0, drawListVertNum = 0;
+static GLsizei drawListCountCap = 0, drawListVertCap = 0;
+static GLuint vao = 0;
+
+// Pending arcs, only one of the arc & line lists holds anything at a time
+// so draw order is kept when switching between them
+static arc* arcList = NULL;
+static GLsizei arcCount = 0, arcCap = 0;
+static GLuint arcVao = 0;
+
+// Ring buffers are split into sections fenced as the write head leaves
+// them, a busy section grows the ring instead of waiting on the GPU
+// until it reaches STREAM_MAX_SIZE, after which the CPU waits instead
+#define STREAM_SECTIONS 4
+#define STREAM_INIT_SIZE (256 * 1024)
+#define STREAM_MAX_SIZE (16 * 1024 * 1024)
+
+typedef struct
+{
+	GLenum target;
+	GLuint buf;
+	GLsizeiptr size, head;
+	int section;
+	uint8_t* map;  // Persistent mapping, NULL when orphaning
+	bool mapped;   // Range mapped by StreamAlloc when orphaning
+	bool rebind;   // Buffer was recreated & needs binding to the VAO
+	GLsync fences[STREAM_SECTIONS];
+} StreamBuffer;
+
+static bool persistent = false;
+static StreamBuffer
+	vtxStream = { .target = GL_ARRAY_BUFFER },
+	idxStream = { .target = GL_ELEMENT_ARRAY_BUFFER };
+
+
+// Retained layers keep captured geometry in their own buffers
+typedef struct
+{
+	GLuint vao, vbo, ibo;
+	vertex* verts;
+	uint32_t* indices;
+	GLsizei vertNum, vertCap, count, countCap;
+	bool valid, failed;
+} Layer;
+static Layer layers[MAX_DRAW_LAYERS];
+static int layerCapture = -1;
 
-static GLuint program = 0;
-static GLint uView, uColour, uScaleFact;
+static GLuint program = 0, arcProgram = 0;
+static GLint uView, uScaleFact, uArcView;
 
+// Expand lines w/ instancing in the vertex shader instead of a geometry shader
+static bool instanced = false;
 
-#if DRAWLIST_MAX_SIZE < 2 || DRAWLIST_MAX_SIZE >= UINT16_MAX
- #error DRAWLIST_MAX_SIZE must be larger than 1 and smaller than 65535
-#endif
 
 #if !defined NDEBUG && !defined __APPLE__
 static void GlErrorCb(
@@ -55,7 +139,7 @@ static void GlErrorCb(
 #endif
 
 
-void DrawWindowHints(void)
+static void BackendWindowHints(void)
 {
 	// Modern OpenGL profile
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, OPENGL_VERSION_MAJOR);
@@ -104,7 +188,8 @@ static inline GLuint LinkProgram(
 
 	// Attach shaders & link program
 	glAttachShader(progId, vertShader);
-	glAttachShader(progId, geomShader);
+	if (geomShader)
+		glAttachShader(progId, geomShader);
 	glAttachShader(progId, fragShader);
 	glLinkProgram(progId);
 
@@ -127,7 +212,509 @@ static inline GLuint LinkProgram(
 	return progId;
 }
 
-int InitDraw(SDL_Window* _window)
+static GLuint BuildProgram(
+	const char* vertSrc, const char* geomSrc, const char* fragSrc,
+	const char* const attrNames[], GLuint attrCount)
+{
+	GLuint vert = CompilerShader(vertSrc, GL_VERTEX_SHADER);
+	if (!vert)
+		return 0;
+	GLuint geom = 0;
+	if (geomSrc && !(geom = CompilerShader(geomSrc, GL_GEOMETRY_SHADER)))
+	{
+		glDeleteShader(vert);
+		return 0;
+	}
+	GLuint frag = CompilerShader(fragSrc, GL_FRAGMENT_SHADER);
+	if (!frag)
+	{
+		if (geom)
+			glDeleteShader(geom);
+		glDeleteShader(vert);
+		return 0;
+	}
+
+	GLuint progId = LinkProgram(vert, geom, frag, attrNames, attrCount);
+	glDeleteShader(frag);
+	if (geom)
+		glDeleteShader(geom);
+	glDeleteShader(vert);
+	return progId;
+}
+
+// Ensure an array has room for 'need' elements, doubling its capacity
+static bool Reserve(void** data, GLsizei* cap, GLsizei need, size_t elemSize)
+{
+	if (need <= *cap)
+		return true;
+	GLsizei newCap = MAX(*cap * 2, MAX(need, 64));
+	void* tmp = realloc(*data, (size_t)newCap * elemSize);
+	if (!tmp)
+		return false;
+	*data = tmp;
+	*cap = newCap;
+	return true;
+}
+
+static bool HasExtension(const char* name)
+{
+	GLint num = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num);
+	for (GLint i = 0; i < num; ++i)
+		if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i), name))
+			return true;
+	return false;
+}
+
+static void FreeStream(StreamBuffer* s)
+{
+	for (int i = 0; i < STREAM_SECTIONS; ++i)
+	{
+		if (s->fences[i])
+			glDeleteSync(s->fences[i]);
+		s->fences[i] = NULL;
+	}
+	if (s->buf)
+		glDeleteBuffers(1, &s->buf); // Implicitly unmaps
+	s->buf = 0;
+	s->map = NULL;
+	s->mapped = false;
+	s->size = s->head = 0;
+	s->section = 0;
+}
+
+static int CreateStream(StreamBuffer* s, GLsizeiptr size)
+{
+	FreeStream(s);
+	glGenBuffers(1, &s->buf);
+	glBindBuffer(s->target, s->buf);
+	if (persistent)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(s->target, size, NULL, flags);
+		s->map = glMapBufferRange(s->target, 0, size, flags);
+		if (!s->map)
+		{
+			fprintf(stderr, "Failed to map stream buffer\n");
+			FreeStream(s);
+			return -1;
+		}
+	}
+	else
+	{
+		glBufferData(s->target, size, NULL, GL_STREAM_DRAW);
+	}
+	s->size = size;
+	s->rebind = true;
+	return 0;
+}
+
+// Describe the vertex layout to the bound VAO & array buffer
+static void SetVertexFormat(void)
+{
+	glVertexAttribPointer(ATTRIB_VERTPOS, 2, GL_FLOAT, GL_FALSE,
+		sizeof(vertex), (GLvoid*)offsetof(vertex, x));
+	glVertexAttribPointer(ATTRIB_VERTCOLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+		sizeof(vertex), (GLvoid*)offsetof(vertex, colour));
+}
+
+// Describe the instanced segment layout starting at 'offset' in the bound array buffer
+static void SetSegmentFormat(GLintptr offset)
+{
+	glVertexAttribPointer(ATTRIB_LINEFROM, 2, GL_FLOAT, GL_FALSE,
+		sizeof(segment), (GLvoid*)(offset + offsetof(segment, from.x)));
+	glVertexAttribPointer(ATTRIB_LINETO, 2, GL_FLOAT, GL_FALSE,
+		sizeof(segment), (GLvoid*)(offset + offsetof(segment, to.x)));
+	glVertexAttribPointer(ATTRIB_LINEFROMCOLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+		sizeof(segment), (GLvoid*)(offset + offsetof(segment, from.colour)));
+	glVertexAttribPointer(ATTRIB_LINETOCOLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+		sizeof(segment), (GLvoid*)(offset + offsetof(segment, to.colour)));
+}
+
+// Enable the attributes used by the current line path on the bound VAO
+static void EnableAttributes(void)
+{
+	const GLuint num = instanced ? NUM_LINE_ATTRIBS : NUM_ATTRIBS;
+	for (GLuint i = 0; i < num; ++i)
+	{
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, instanced ? 1 : 0);
+	}
+}
+
+// Write each indexed line in the draw list out as a segment
+static void ExpandSegments(segment* out, const vertex* verts, const uint32_t* indices, GLsizei count)
+{
+	for (GLsizei i = 0; i < count; i += 2)
+		*out++ = (segment){verts[indices[i]], verts[indices[i + 1]]};
+}
+
+// Pick the line expansion path, defaulting to instancing on software
+// rasterisers where geometry shaders are especially slow
+static bool UseInstancedLines(void)
+{
+	const char* env = getenv("PADLAB_GL_LINES");
+	if (env && !strcmp(env, "instanced"))
+		return true;
+	if (env && !strcmp(env, "geometry"))
+		return false;
+
+	const char* rend = (const char*)glGetString(GL_RENDERER);
+	return rend && (strstr(rend, "llvmpipe") || strstr(rend, "softpipe"));
+}
+
+// Point the draw list VAO at the current stream buffers
+static void BindStreams(void)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, vtxStream.buf);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idxStream.buf);
+	if (!instanced)
+		SetVertexFormat(); // Segment offsets are set on each flush
+	vtxStream.rebind = idxStream.rebind = false;
+}
+
+// Enter a section of a persistent stream, fencing the one being left
+//
+// Params:
+//   wait - Block until the GPU is done with the section.
+//
+// Returns:
+//   false if the GPU may still be reading from the section.
+static bool StreamEnterSection(StreamBuffer* s, int section, bool wait)
+{
+	s->fences[s->section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	s->section = section;
+
+	GLsync fence = s->fences[section];
+	if (!fence)
+		return true;
+	const GLenum res = wait
+		? glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX)
+		: glClientWaitSync(fence, 0, 0);
+	if (res == GL_TIMEOUT_EXPIRED)
+		return false;
+	glDeleteSync(fence);
+	s->fences[section] = NULL;
+	return true;
+}
+
+// Allocate space to write to in a stream, only stalling once the ring
+// has grown to STREAM_MAX_SIZE
+//
+// Returns:
+//   Pointer to write 'bytes' to, with the buffer offset in 'offset',
+//   or NULL on failure. Call StreamCommit once written.
+static void* StreamAlloc(StreamBuffer* s, GLsizeiptr bytes, GLsizeiptr align, GLintptr* offset)
+{
+	// Allocations never span more than two sections
+	if (bytes > s->size / STREAM_SECTIONS)
+	{
+		GLsizeiptr newSize = s->size;
+		while (bytes > newSize / STREAM_SECTIONS)
+			newSize *= 2;
+		if (CreateStream(s, newSize))
+			return NULL;
+	}
+
+	const GLsizeiptr sectSize = s->size / STREAM_SECTIONS;
+	GLsizeiptr start = (s->head + align - 1) / align * align;
+	if (start + bytes > s->size)
+		start = 0;
+
+	if (persistent)
+	{
+		const int first = (int)(start / sectSize), last = (int)((start + bytes - 1) / sectSize);
+		const bool wait = s->size * 2 > STREAM_MAX_SIZE;
+		for (int i = first; i <= last; ++i)
+		{
+			if (i != s->section && !StreamEnterSection(s, i, wait))
+			{
+				// Still in flight, grow into a new buffer rather than wait
+				if (CreateStream(s, s->size * 2))
+					return NULL;
+				return StreamAlloc(s, bytes, align, offset);
+			}
+		}
+
+		s->head = start + bytes;
+		*offset = (GLintptr)start;
+		return s->map + start;
+	}
+
+	// Orphan the buffer on wrap, the driver hands back fresh storage
+	// while the GPU finishes with the old contents
+	glBindBuffer(s->target, s->buf);
+	if (start == 0)
+		glBufferData(s->target, s->size, NULL, GL_STREAM_DRAW);
+	void* ptr = glMapBufferRange(s->target, start, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!ptr)
+		return NULL;
+
+	s->mapped = true;
+	s->head = start + bytes;
+	*offset = (GLintptr)start;
+	return ptr;
+}
+
+static void StreamCommit(StreamBuffer* s)
+{
+	if (!s->mapped)
+		return;
+	glBindBuffer(s->target, s->buf);
+	glUnmapBuffer(s->target);
+	s->mapped = false;
+}
+
+// Frame capture reads the back buffer into a ring of pixel pack buffers,
+// each mapped a few frames later when the GPU is long done with it, and
+// hands the pixels to a writer thread so presenting never waits on I/O
+#define CAPTURE_LATENCY 2                     // Frames between a readback & its mapping
+#define CAPTURE_PBOS    (CAPTURE_LATENCY + 1) // Readbacks in flight
+#define CAPTURE_QUEUE   4                     // Frames waiting for the writer thread
+
+typedef struct
+{
+	GLuint pbo;
+	GLsync fence;
+	int w, h;     // Region read, anchored at the top left of the capture size
+	bool pending; // Read back but not yet mapped
+} CaptureSlot;
+
+// The output is opened once & stays open for the process, so switching
+// backends & back continues the stream at the size it started with
+// instead of truncating it or redirecting stdout again
+static FILE* capFile = NULL;
+static size capSize = {0, 0};
+static CaptureSlot capSlots[CAPTURE_PBOS];
+static unsigned capFrame = 0, capWritten = 0, capDropped = 0;
+
+// Queue of top-down RGBA frames, the main thread fills the slot at the
+// head & the writer empties the slot at the tail
+static uint8_t* capQueue[CAPTURE_QUEUE];
+static int capHead = 0, capTail = 0, capCount = 0;
+static bool capRunning = false, capFailed = false;
+static SDL_mutex* capMutex = NULL;
+static SDL_cond* capCond = NULL;
+static SDL_Thread* capThread = NULL;
+
+static size_t CaptureFrameBytes(void)
+{
+	return (size_t)capSize.w * (size_t)capSize.h * 4;
+}
+
+static int SDLCALL CaptureWriter(void* data)
+{
+	SDL_LockMutex(capMutex);
+	for (;;)
+	{
+		while (!capCount && capRunning)
+			SDL_CondWait(capCond, capMutex);
+		if (!capCount)
+			break;
+		const uint8_t* frame = capQueue[capTail];
+		SDL_UnlockMutex(capMutex);
+
+		const bool ok = !capFailed && fwrite(frame, CaptureFrameBytes(), 1, capFile) == 1;
+
+		SDL_LockMutex(capMutex);
+		if (!ok && !capFailed)
+		{
+			fprintf(stderr, "Frame capture write failed, stopping capture\n");
+			capFailed = true;
+		}
+		capWritten += ok;
+		capTail = (capTail + 1) % CAPTURE_QUEUE;
+		--capCount;
+	}
+	SDL_UnlockMutex(capMutex);
+	return 0;
+}
+
+// Open the capture output, "-" streams to stdout
+static FILE* OpenCaptureFile(const char* path)
+{
+	if (strcmp(path, "-"))
+		return fopen(path, "wb");
+
+	// Keep the stream clean by sending anything else printed to stderr
+	fflush(stdout);
+#ifdef _WIN32
+	const int fd = _dup(_fileno(stdout));
+	if (fd < 0 || _dup2(_fileno(stderr), _fileno(stdout)))
+		return NULL;
+	_setmode(fd, _O_BINARY);
+	return _fdopen(fd, "wb");
+#else
+	const int fd = dup(STDOUT_FILENO);
+	if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+		return NULL;
+	return fdopen(fd, "wb");
+#endif
+}
+
+static size BackendGetDrawSize(void);
+static void BackendSetDrawViewport(size size);
+
+static int InitCapture(const char* path)
+{
+	if (!capFile)
+	{
+		capSize = BackendGetDrawSize();
+		if (capSize.w <= 0 || capSize.h <= 0 || (capFile = OpenCaptureFile(path)) == NULL)
+		{
+			fprintf(stderr, "Failed to open \"%s\" for frame capture\n", path);
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < CAPTURE_QUEUE; ++i)
+		if ((capQueue[i] = malloc(CaptureFrameBytes())) == NULL)
+			return -1;
+
+	for (int i = 0; i < CAPTURE_PBOS; ++i)
+	{
+		glGenBuffers(1, &capSlots[i].pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capSlots[i].pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)CaptureFrameBytes(), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	capMutex = SDL_CreateMutex();
+	capCond = SDL_CreateCond();
+	capRunning = true;
+	if (!capMutex || !capCond || (capThread = SDL_CreateThread(CaptureWriter, "capture", NULL)) == NULL)
+	{
+		capRunning = false;
+		return -1;
+	}
+
+	fprintf(stderr, "Capturing %dx%d RGBA frames to %s\n", capSize.w, capSize.h,
+		strcmp(path, "-") ? path : "stdout");
+	return 0;
+}
+
+// Map a finished readback & queue it for writing, dropping it if the writer is behind
+static void CollectCapture(CaptureSlot* slot)
+{
+	slot->pending = false;
+	SDL_LockMutex(capMutex);
+	const bool full = capCount == CAPTURE_QUEUE || capFailed;
+	uint8_t* frame = capQueue[capHead];
+	SDL_UnlockMutex(capMutex);
+
+	// Readbacks are done by now, so the wait only ever applies to the last ones on exit
+	glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+	glDeleteSync(slot->fence);
+	slot->fence = NULL;
+	if (full)
+	{
+		++capDropped;
+		return;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+	const uint8_t* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)CaptureFrameBytes(), GL_MAP_READ_BIT);
+	if (!src)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		++capDropped;
+		return;
+	}
+
+	// GL rows run bottom up, anything outside a smaller window is left black
+	const size_t stride = (size_t)capSize.w * 4, rowBytes = (size_t)slot->w * 4;
+	if (slot->w < capSize.w || slot->h < capSize.h)
+		memset(frame, 0, CaptureFrameBytes());
+	for (int y = 0; y < slot->h; ++y)
+		memcpy(frame + (size_t)y * stride, src + (size_t)(slot->h - 1 - y) * stride, rowBytes);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	SDL_LockMutex(capMutex);
+	capHead = (capHead + 1) % CAPTURE_QUEUE;
+	++capCount;
+	SDL_CondSignal(capCond);
+	SDL_UnlockMutex(capMutex);
+}
+
+// Start reading back the frame about to be presented
+static void CaptureFrame(void)
+{
+	CaptureSlot* slot = &capSlots[capFrame % CAPTURE_PBOS];
+	if (slot->pending)
+		CollectCapture(slot);
+
+	// The capture size is fixed, read the overlap with the current drawable
+	const size cur = BackendGetDrawSize();
+	slot->w = MIN(cur.w, capSize.w);
+	slot->h = MIN(cur.h, capSize.h);
+	if (slot->w > 0 && slot->h > 0)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+		glPixelStorei(GL_PACK_ROW_LENGTH, capSize.w);
+		glReadBuffer(GL_BACK);
+		glReadPixels(0, cur.h - slot->h, slot->w, slot->h, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+		glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot->pending = true;
+	}
+	++capFrame;
+
+	CaptureSlot* ready = &capSlots[(capFrame - 1 - CAPTURE_LATENCY) % CAPTURE_PBOS];
+	if (capFrame > CAPTURE_LATENCY && ready->pending)
+		CollectCapture(ready);
+}
+
+// Write out the readbacks still in flight & stop the writer thread
+static void QuitCapture(void)
+{
+	if (capRunning)
+	{
+		for (unsigned i = 0; i < CAPTURE_PBOS; ++i)
+		{
+			CaptureSlot* slot = &capSlots[(capFrame + i) % CAPTURE_PBOS];
+			if (slot->pending)
+				CollectCapture(slot);
+		}
+
+		SDL_LockMutex(capMutex);
+		capRunning = false;
+		SDL_CondSignal(capCond);
+		SDL_UnlockMutex(capMutex);
+		SDL_WaitThread(capThread, NULL);
+		fprintf(stderr, "Captured %u frames, dropped %u\n", capWritten, capDropped);
+	}
+	capThread = NULL;
+
+	for (int i = 0; i < CAPTURE_PBOS; ++i)
+	{
+		if (capSlots[i].fence)
+			glDeleteSync(capSlots[i].fence);
+		if (capSlots[i].pbo)
+			glDeleteBuffers(1, &capSlots[i].pbo);
+		capSlots[i] = (CaptureSlot){0};
+	}
+	for (int i = 0; i < CAPTURE_QUEUE; ++i)
+	{
+		free(capQueue[i]);
+		capQueue[i] = NULL;
+	}
+	if (capCond)
+		SDL_DestroyCond(capCond);
+	if (capMutex)
+		SDL_DestroyMutex(capMutex);
+	capCond = NULL;
+	capMutex = NULL;
+	if (capFile && fflush(capFile))
+		fprintf(stderr, "Frame capture write failed\n");
+	capFrame = capWritten = capDropped = 0;
+	capHead = capTail = capCount = 0;
+	capFailed = false;
+}
+
+static int BackendInit(SDL_Window* _window)
 {
 	window = _window;
 	ctx = SDL_GL_CreateContext(window);
@@ -164,36 +751,33 @@ int InitDraw(SDL_Window* _window)
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glBlendEquation(GL_FUNC_ADD);
 
-	// Compile shaders
-	GLuint vert = CompilerShader(vert_glsl, GL_VERTEX_SHADER);
-	if (!vert)
-		return -1;
-	GLuint geom = CompilerShader(geom_glsl, GL_GEOMETRY_SHADER);
-	if (!geom)
-	{
-		glDeleteShader(vert);
-		return -1;
-	}
-	GLuint frag = CompilerShader(frag_glsl, GL_FRAGMENT_SHADER);
-	if (!frag)
-	{
-		glDeleteShader(geom);
-		glDeleteShader(vert);
-		return -1;
-	}
+	instanced = UseInstancedLines();
+	if (getenv("PADLAB_GL_LINES")) // Confirm the override took
+		fprintf(stderr, "Using %s line expansion\n", instanced ? "instanced" : "geometry shader");
 
-	// Link program
-	program = LinkProgram(vert, geom, frag, attribNames, NUM_ATTRIBS);
-	glDeleteShader(frag);
-	glDeleteShader(geom);
-	glDeleteShader(vert);
+	// Compile & link programs
+	program = instanced
+		? BuildProgram(vert_line_glsl, NULL, frag_glsl, lineAttribNames, NUM_LINE_ATTRIBS)
+		: BuildProgram(vert_glsl, geom_glsl, frag_glsl, attribNames, NUM_ATTRIBS);
 	if (!program)
 		return -1;
+	arcProgram = BuildProgram(vert_arc_glsl, NULL, frag_arc_glsl, arcAttribNames, NUM_ARC_ATTRIBS);
+	if (!arcProgram)
+		return -1;
 
 	// Get uniforms
 	uView = glGetUniformLocation(program, "uView");
-	uColour = glGetUniformLocation(program, "uColour");
 	uScaleFact = glGetUniformLocation(program, "uScaleFact");
+	uArcView = glGetUniformLocation(arcProgram, "uView");
+
+	// Setup arc instance attributes
+	glGenVertexArrays(1, &arcVao);
+	glBindVertexArray(arcVao);
+	for (GLuint i = 0; i < NUM_ARC_ATTRIBS; ++i)
+	{
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
 
 	glUseProgram(program); // Use program
 
@@ -201,52 +785,74 @@ int InitDraw(SDL_Window* _window)
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 
-	// Setup draw list
-	glGenBuffers(1, &drawListVbo);
-	glBindBuffer(GL_ARRAY_BUFFER, drawListVbo);
-	glGenBuffers(1, &drawListIbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawListIbo);
-
-	glBufferData(GL_ARRAY_BUFFER, DRAWLIST_MAX_SIZE * sizeof(vertex), NULL, GL_DYNAMIC_DRAW);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, DRAWLIST_MAX_SIZE * sizeof(uint16_t), NULL, GL_DYNAMIC_DRAW);
-
-	// Setup draw list vertex attributes
-	glEnableVertexAttribArray(ATTRIB_VERTPOS);
-	glVertexAttribPointer(ATTRIB_VERTPOS, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid*)0);
+	// Setup streaming buffers, persistently mapped when supported
+	// The instanced path has no use for indices
+	persistent = gl3wIsSupported(4, 4) || HasExtension("GL_ARB_buffer_storage");
+	if (CreateStream(&vtxStream, STREAM_INIT_SIZE) ||
+		(!instanced && CreateStream(&idxStream, STREAM_INIT_SIZE)))
+		return -1;
+	EnableAttributes();
+	BindStreams();
 
 	// Reset viewport & clear
-	SetDrawViewport(GetDrawSizeInPixels());
-	glUniform4f(uColour, 1.0f, 1.0f, 1.0f, 1.0f);
+	BackendSetDrawViewport(BackendGetDrawSize());
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
 
+	const char* capture = getenv("PADLAB_GL_CAPTURE");
+	if (capture && *capture && InitCapture(capture))
+		return -1;
+
 	return 0;
 }
 
-void QuitDraw(void)
+static void FreeLayer(Layer* l)
 {
-	if (drawListVbo)
-	{
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glDeleteBuffers(1, &drawListVbo);
-		drawListVbo = 0;
-	}
+	if (l->vao)
+		glDeleteVertexArrays(1, &l->vao);
+	if (l->vbo)
+		glDeleteBuffers(1, &l->vbo);
+	if (l->ibo)
+		glDeleteBuffers(1, &l->ibo);
+	free(l->verts);
+	free(l->indices);
+	*l = (Layer){0};
+}
 
-	if (drawListIbo)
-	{
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-		glDeleteBuffers(1, &drawListIbo);
-		drawListIbo = 0;
-	}
+static void BackendQuit(void)
+{
+	QuitCapture();
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+		FreeLayer(&layers[i]);
+	layerCapture = -1;
+
+	FreeStream(&vtxStream);
+	FreeStream(&idxStream);
+	free(drawListVerts);
+	free(drawListIndices);
+	drawListVerts = NULL;
+	drawListIndices = NULL;
+	drawListVertCap = drawListCountCap = 0;
+	drawListVertNum = drawListCount = 0;
+
+	free(arcList);
+	arcList = NULL;
+	arcCap = arcCount = 0;
 
 	if (vao)
 	{
-		glDisableVertexAttribArray(ATTRIB_VERTPOS);
 		glBindVertexArray(0);
 		glDeleteVertexArrays(1, &vao);
 		vao = 0;
 	}
 
+	if (arcVao)
+	{
+		glDeleteVertexArrays(1, &arcVao);
+		arcVao = 0;
+	}
+
+	// GL may not even be loaded if initialisation failed early
 	if (program)
 	{
 		glUseProgram(0);
@@ -254,104 +860,262 @@ void QuitDraw(void)
 		program = 0;
 	}
 
+	if (arcProgram)
+	{
+		glDeleteProgram(arcProgram);
+		arcProgram = 0;
+	}
+
 	SDL_GL_MakeCurrent(window, NULL);
 	SDL_GL_DeleteContext(ctx);
 	ctx = NULL;
 	window = NULL;
+
+	// Init clears the new context to zero, so forget the cached clear colour
+	colour = vertColour = clrColour = 0x00000000;
 }
 
 
-size GetDrawSizeInPixels(void)
+static size BackendGetDrawSize(void)
 {
 	size out;
 	SDL_GL_GetDrawableSize(SDL_GL_GetCurrentWindow(), &out.w, &out.h);
 	return out;
 }
 
-void SetDrawViewport(size size)
+static void BackendSetDrawViewport(size size)
 {
 	glViewport(0, 0, size.w, size.h);
-	vertex s = (vertex){2.0f / (float)size.w, 2.0f / (float)size.h};
+	const float sx = 2.0f / (float)size.w, sy = 2.0f / (float)size.h;
 	float mat[16] = {
-		  s.x,  0.0f, 0.0f, 0.0f,
-		 0.0f,  -s.y, 0.0f, 0.0f,
+		   sx,  0.0f, 0.0f, 0.0f,
+		 0.0f,   -sy, 0.0f, 0.0f,
 		 0.0f,  0.0f, 1.0f, 0.0f,
 		-1.0f,  1.0f, 0.0f, 1.0f};
 	glUniformMatrix4fv(uView, 1, GL_FALSE, mat);
 	glUniform2f(uScaleFact, 1.0f / (float)size.w, 1.0f / (float)size.h);
+
+	glUseProgram(arcProgram);
+	glUniformMatrix4fv(uArcView, 1, GL_FALSE, mat);
+	glUseProgram(program);
+}
+
+
+static void CaptureDrawBuffers(Layer* l)
+{
+	if (l->failed)
+		return;
+	if (!Reserve((void**)&l->verts, &l->vertCap, l->vertNum + drawListVertNum, sizeof(vertex)) ||
+		!Reserve((void**)&l->indices, &l->countCap, l->count + drawListCount, sizeof(uint32_t)))
+	{
+		fprintf(stderr, "Out of memory capturing draw layer\n");
+		l->failed = true;
+		return;
+	}
+
+	memcpy(&l->verts[l->vertNum], drawListVerts, drawListVertNum * sizeof(vertex));
+	for (GLsizei i = 0; i < drawListCount; ++i)
+		l->indices[l->count + i] = (uint32_t)l->vertNum + drawListIndices[i];
+
+	l->vertNum += drawListVertNum;
+	l->count += drawListCount;
 }
 
+static void FlushSegments(void);
+static void FlushIndexed(void);
+
+static void FlushArcs(void)
+{
+	TRACE_BEGIN("flush arcs");
+	GLintptr ofs;
+	arc* dst = StreamAlloc(&vtxStream, arcCount * (GLsizeiptr)sizeof(arc), sizeof(float), &ofs);
+	if (dst)
+		memcpy(dst, arcList, arcCount * sizeof(arc));
+	StreamCommit(&vtxStream);
+
+	if (dst)
+	{
+		glUseProgram(arcProgram);
+		glBindVertexArray(arcVao);
+		glBindBuffer(GL_ARRAY_BUFFER, vtxStream.buf);
+		glVertexAttribPointer(ATTRIB_ARCCIRCLE, 3, GL_FLOAT, GL_FALSE,
+			sizeof(arc), (GLvoid*)(ofs + offsetof(arc, x)));
+		glVertexAttribPointer(ATTRIB_ARCANGLES, 2, GL_FLOAT, GL_FALSE,
+			sizeof(arc), (GLvoid*)(ofs + offsetof(arc, start)));
+		glVertexAttribPointer(ATTRIB_ARCCOLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+			sizeof(arc), (GLvoid*)(ofs + offsetof(arc, colour)));
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, arcCount);
+		glBindVertexArray(vao);
+		glUseProgram(program);
+		CounterAdd(COUNTER_DRAW_CALLS, 1);
+		CounterAdd(COUNTER_FLUSHES, 1);
+		CounterAdd(COUNTER_VERTICES, (uint64_t)arcCount * 4);
+	}
+
+	arcCount = 0;
+	TRACE_END();
+}
 
-static int drawCount = 0;
 static void FlushDrawBuffers(void)
 {
+	if (arcCount)
+		FlushArcs();
 	if (!drawListCount)
 		return;
 
-	GLsizeiptr vboSize = drawListVertNum * (GLsizeiptr)sizeof(vertex);
-	GLsizeiptr iboSize = drawListCount * (GLsizeiptr)sizeof(uint16_t);
-	glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)0, vboSize, drawListVerts);
-	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)0, iboSize, drawListIndices);
-
-	glDrawElements(GL_LINES, drawListCount, GL_UNSIGNED_SHORT, (GLvoid*)0);
+	TRACE_BEGIN("flush");
+	if (layerCapture >= 0)
+		CaptureDrawBuffers(&layers[layerCapture]);
+	else if (instanced)
+		FlushSegments();
+	else
+		FlushIndexed();
+	TRACE_END();
 
 	drawListVertNum = 0;
 	drawListCount = 0;
-	++drawCount;
 }
 
-static void UnpackColour(GLfloat* out)
+static void FlushSegments(void)
+{
+	const GLsizei numSegs = drawListCount / 2;
+
+	GLintptr ofs;
+	segment* segs = StreamAlloc(&vtxStream, numSegs * (GLsizeiptr)sizeof(segment), sizeof(float), &ofs);
+	if (segs)
+		ExpandSegments(segs, drawListVerts, drawListIndices, drawListCount);
+	StreamCommit(&vtxStream);
+	if (!segs)
+		return;
+
+	if (vtxStream.rebind)
+		BindStreams();
+	SetSegmentFormat(ofs);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 8, numSegs);
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+	CounterAdd(COUNTER_FLUSHES, 1);
+	CounterAdd(COUNTER_VERTICES, (uint64_t)numSegs * 8);
+}
+
+static void FlushIndexed(void)
+{
+	// Narrow indices to 16 bits unless the batch addresses more vertices
+	const bool wide = drawListVertNum > 0x10000;
+	const GLsizeiptr indexSize = wide ? sizeof(uint32_t) : sizeof(uint16_t);
+
+	GLintptr vtxOfs, idxOfs;
+	vertex* vtx = StreamAlloc(&vtxStream,
+		drawListVertNum * (GLsizeiptr)sizeof(vertex), sizeof(vertex), &vtxOfs);
+	void* idx = vtx ? StreamAlloc(&idxStream,
+		drawListCount * indexSize, sizeof(uint32_t), &idxOfs) : NULL;
+	if (idx)
+	{
+		memcpy(vtx, drawListVerts, drawListVertNum * sizeof(vertex));
+		if (wide)
+		{
+			memcpy(idx, drawListIndices, drawListCount * sizeof(uint32_t));
+		}
+		else
+		{
+			uint16_t* out = idx;
+			for (GLsizei i = 0; i < drawListCount; ++i)
+				out[i] = (uint16_t)drawListIndices[i];
+		}
+	}
+	StreamCommit(&vtxStream);
+	StreamCommit(&idxStream);
+
+	if (idx)
+	{
+		if (vtxStream.rebind || idxStream.rebind)
+			BindStreams();
+		glDrawElementsBaseVertex(GL_LINES, drawListCount,
+			wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT, (GLvoid*)idxOfs,
+			(GLint)(vtxOfs / (GLintptr)sizeof(vertex)));
+		CounterAdd(COUNTER_DRAW_CALLS, 1);
+		CounterAdd(COUNTER_FLUSHES, 1);
+		CounterAdd(COUNTER_VERTICES, (uint64_t)drawListVertNum);
+		CounterAdd(COUNTER_INDICES, (uint64_t)drawListCount);
+	}
+}
+
+// Make room in the draw list for more vertices & indices
+//
+// Returns:
+//   false if there isn't enough memory to add them.
+static bool ReserveDrawList(GLsizei verts, GLsizei indices)
+{
+	if (arcCount)
+		FlushArcs();
+
+	if (Reserve((void**)&drawListVerts, &drawListVertCap, drawListVertNum + verts, sizeof(vertex)) &&
+		Reserve((void**)&drawListIndices, &drawListCountCap, drawListCount + indices, sizeof(uint32_t)))
+		return true;
+
+	// Draw what's already there to free up space
+	FlushDrawBuffers();
+	return verts <= drawListVertCap && indices <= drawListCountCap;
+}
+
+static void UnpackColour(uint32_t c, GLfloat* out)
 {
 	const float mul = 1.0f / 255.0f;
-	out[0] = (GLfloat)((colour & 0xFF000000) >> 24) * mul;
-	out[1] = (GLfloat)((colour & 0x00FF0000) >> 16) * mul;
-	out[2] = (GLfloat)((colour & 0x0000FF00) >>  8) * mul;
-	out[3] = (GLfloat)((colour & 0x000000FF)) * mul;
+	out[0] = (GLfloat)((c & 0xFF000000) >> 24) * mul;
+	out[1] = (GLfloat)((c & 0x00FF0000) >> 16) * mul;
+	out[2] = (GLfloat)((c & 0x0000FF00) >>  8) * mul;
+	out[3] = (GLfloat)((c & 0x000000FF)) * mul;
 }
 
-static void UpdateDrawColour(void)
+// Pack a colour into RGBA8 byte order for the vertex attribute
+static uint32_t PackColour(uint32_t c)
 {
-	FlushDrawBuffers();                   // Flush anything that might still be in the buffer
-	GLfloat draw[4]; UnpackColour(draw);  // Convert packed RGBA32 to float
-	glUniform4fv(uColour, 1, draw);       // Pass new colour to shader
-	drawColour = colour;                  // Mark state as up to date
+	const uint8_t rgba[4] = {
+		(uint8_t)((c & 0xFF000000) >> 24),
+		(uint8_t)((c & 0x00FF0000) >> 16),
+		(uint8_t)((c & 0x0000FF00) >>  8),
+		(uint8_t)((c & 0x000000FF)) };
+	uint32_t out;
+	memcpy(&out, rgba, sizeof(out));
+	return out;
 }
 
 
-void SetDrawColour(uint32_t c)
+static void BackendSetDrawColour(uint32_t c)
 {
 	colour = c;
+	vertColour = PackColour(c);
 }
 
-void DrawClear(void)
+static void BackendDrawClear(void)
 {
 	if (clrColour != colour)
 	{
-		GLfloat clear[4]; UnpackColour(clear);
+		GLfloat clear[4]; UnpackColour(colour, clear);
 		glClearColor(clear[0], clear[1], clear[2], clear[3]);
 		clrColour = colour;
 	}
 	glClear(GL_COLOR_BUFFER_BIT);
 }
 
-void DrawPoint(int x, int y)
+static void BackendDrawCircleSteps(int x, int y, int r, int steps);
+static bool BackendDrawArcAnalytic(int x, int y, int r, int startAng, int endAng);
+
+static void BackendDrawPoint(int x, int y)
 {
-	DrawCircleSteps(x, y, 1, 4);
+	if (!BackendDrawArcAnalytic(x, y, 1, 0, 360))
+		BackendDrawCircleSteps(x, y, 1, 4);
 }
 
-void DrawRect(int x, int y, int w, int h)
+static void BackendDrawRect(int x, int y, int w, int h)
 {
-#if 8 <= DRAWLIST_MAX_SIZE
-	if (drawColour != colour)
-		UpdateDrawColour();
-	else if (drawListCount > DRAWLIST_MAX_SIZE - 8)
-		FlushDrawBuffers();
+	if (!ReserveDrawList(4, 8))
+		return;
 
-	uint16_t base = drawListVertNum;
-	drawListVerts[drawListVertNum++] = (vertex){(float)x, (float)y};
-	drawListVerts[drawListVertNum++] = (vertex){(float)x + (float)w, (float)y};
-	drawListVerts[drawListVertNum++] = (vertex){(float)x + (float)w, (float)y + (float)h};
-	drawListVerts[drawListVertNum++] = (vertex){(float)x, (float)y + (float)h};
+	const uint32_t base = (uint32_t)drawListVertNum;
+	drawListVerts[drawListVertNum++] = (vertex){(float)x, (float)y, vertColour};
+	drawListVerts[drawListVertNum++] = (vertex){(float)x + (float)w, (float)y, vertColour};
+	drawListVerts[drawListVertNum++] = (vertex){(float)x + (float)w, (float)y + (float)h, vertColour};
+	drawListVerts[drawListVertNum++] = (vertex){(float)x, (float)y + (float)h, vertColour};
 	drawListIndices[drawListCount++] = base;
 	drawListIndices[drawListCount++] = base + 1;
 	drawListIndices[drawListCount++] = base + 1;
@@ -360,132 +1124,223 @@ void DrawRect(int x, int y, int w, int h)
 	drawListIndices[drawListCount++] = base + 3;
 	drawListIndices[drawListCount++] = base + 3;
 	drawListIndices[drawListCount++] = base;
-
-	if (drawListCount == DRAWLIST_MAX_SIZE)
-		FlushDrawBuffers();
-#else
- #pragma message("DRAWLIST_MAX_SIZE is too low, DrawRect functionality disabled")
-#endif
 }
 
-void DrawLine(int x1, int y1, int x2, int y2)
+static void BackendDrawLines(const point* points, int count)
 {
-	if (drawColour != colour)
-		UpdateDrawColour();
-	else if (drawListCount > DRAWLIST_MAX_SIZE - 2)
-		FlushDrawBuffers();
+	if (count < 2 || !ReserveDrawList(count, (count - 1) * 2))
+		return;
+
+	vertex from = {(float)points[0].x, (float)points[0].y, vertColour};
+	if (!(drawListVertNum > 0 && memcmp(&from, &drawListVerts[drawListVertNum - 1], sizeof(vertex)) == 0))
+		drawListVerts[drawListVertNum++] = from;
 
-	vertex from = {(float)x1, (float)y1}, to = {(float)x2, (float)y2};
-	if (drawListVertNum > 0 && memcmp(&from, &drawListVerts[drawListVertNum - 1], sizeof(vertex)) == 0)
+	// Each inner point is shared by the segments either side of it
+	const uint32_t base = (uint32_t)drawListVertNum - 1;
+	for (int i = 1; i < count; ++i)
 	{
-		// Reuse last vertex
-		drawListIndices[drawListCount++] = drawListVertNum - 1;
+		drawListIndices[drawListCount++] = (uint32_t)drawListVertNum - 1;
+		if (i == count - 1 && points[i].x == points[0].x && points[i].y == points[0].y)
+		{
+			// Close loops on the first vertex
+			drawListIndices[drawListCount++] = base;
+			break;
+		}
+		drawListVerts[drawListVertNum] = (vertex){(float)points[i].x, (float)points[i].y, vertColour};
+		drawListIndices[drawListCount++] = (uint32_t)drawListVertNum++;
 	}
-	else
+}
+
+static void BackendDrawCircleSteps(int x, int y, int r, int steps)
+{
+	const tessvec* unit = GetUnitArc(360, steps);
+	if (!unit || !ReserveDrawList(steps, steps * 2))
+		return;
+
+	const float fx = (float)x, fy = (float)y;
+	const float mag = (float)r;
+
+	// Draw whole circle in a single loop
+	const uint32_t base = (uint32_t)drawListVertNum;
+	drawListVerts[drawListVertNum] = (vertex){fx + unit[0].x * mag, fy + unit[0].y * mag, vertColour};
+	drawListIndices[drawListCount++] = (uint32_t)drawListVertNum++;
+	for (int i = 1; i < steps; ++i)
 	{
-		drawListVerts[drawListVertNum] = from;
-		drawListIndices[drawListCount++] = drawListVertNum++;
+		drawListVerts[drawListVertNum] = (vertex){fx + unit[i].x * mag, fy + unit[i].y * mag, vertColour};
+		drawListIndices[drawListCount++] = (uint32_t)drawListVertNum;
+		drawListIndices[drawListCount++] = (uint32_t)drawListVertNum++;
 	}
-	drawListVerts[drawListVertNum] = to;
-	drawListIndices[drawListCount++] = drawListVertNum++;
+	drawListIndices[drawListCount++] = base;
 }
 
-static void ArcSubSlice(
-	float x, float y,
-	float magx, float magy,
-	float angle, float stride,
-	int num)
+static void BackendDrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
 {
-	if (!num)
+	const tessvec* unit = GetUnitArc(endAng - startAng, steps);
+	if (!unit || !ReserveDrawList(steps + 1, steps * 2))
 		return;
-	drawListVerts[drawListVertNum] = (vertex){
-		x + cosf(angle) * magx,
-		y - sinf(angle) * magy};
-	for (int i = 1; i <= num; ++i)
-	{
-		const float theta = angle + stride * (float)i;
-		float ofsx = cosf(theta) * magx;
-		float ofsy = sinf(theta) * magy;
 
-		drawListIndices[drawListCount++] = drawListVertNum++;
-		drawListVerts[drawListVertNum] = (vertex){x + ofsx, y - ofsy};
-		drawListIndices[drawListCount++] = drawListVertNum;
+	const float fx = (float)x, fy = (float)y;
+	const float mag = (float)r;
+	const tessvec dir = GetUnitDirection(startAng);
+
+	tessvec ofs = TessRotate(unit[0], dir);
+	drawListVerts[drawListVertNum] = (vertex){fx + ofs.x * mag, fy + ofs.y * mag, vertColour};
+	for (int i = 1; i <= steps; ++i)
+	{
+		ofs = TessRotate(unit[i], dir);
+		drawListIndices[drawListCount++] = (uint32_t)drawListVertNum++;
+		drawListVerts[drawListVertNum] = (vertex){fx + ofs.x * mag, fy + ofs.y * mag, vertColour};
+		drawListIndices[drawListCount++] = (uint32_t)drawListVertNum;
 	}
 	drawListVertNum++;
 }
 
-static void ArcSlice(
-	float x, float y,
-	float magx, float magy,
-	float angle, float stride,
-	int steps)
+static bool BackendDrawArcAnalytic(int x, int y, int r, int startAng, int endAng)
 {
-	int i = 0;
-	while (true)
-	{
-		const int subSteps = (MIN(drawListCount + (steps - i) * 2, DRAWLIST_MAX_SIZE) - drawListCount) / 2;
-		if (subSteps)
-			ArcSubSlice(x, y, magx, magy, angle, stride, subSteps);
-		i += subSteps;
-		if (i < steps)
-			FlushDrawBuffers();
-		else
-			break;
-		angle += stride * (float)subSteps;
-	}
+	// Layers only hold lines, leave them to be tessellated
+	if (layerCapture >= 0)
+		return false;
+
+	if (drawListCount)
+		FlushDrawBuffers();
+	if (!Reserve((void**)&arcList, &arcCap, arcCount + 1, sizeof(arc)))
+		return false;
+
+	// Spans past a full turn skip the angle test in the shader
+	const int span = abs(endAng - startAng);
+	arcList[arcCount++] = (arc){
+		(float)x, (float)y, (float)r,
+		(float)(MIN(startAng, endAng) * DEG2RAD),
+		span >= 360 ? (float)TAU * 2.0f : (float)(span * DEG2RAD),
+		vertColour};
+	return true;
 }
 
-void DrawCircleSteps(int x, int y, int r, int steps)
+static void BackendBeginDrawLayer(int layer, rect bounds)
 {
-	if (drawColour != colour)
-		UpdateDrawColour();
+	FlushDrawBuffers();
 
-	const float fx = (float)x, fy = (float)y;
-	const float stepSz = (float)TAU / (float)abs(steps);
-	const float mag = (float)r;
-	// Check if whole circle can fit in the buffer
-	if (drawListCount > DRAWLIST_MAX_SIZE - steps * 2)
+	Layer* l = &layers[layer];
+	l->vertNum = l->count = 0;
+	l->valid = l->failed = false;
+	layerCapture = layer;
+}
+
+static void BackendEndDrawLayer(void)
+{
+	if (layerCapture < 0)
+		return;
+	FlushDrawBuffers();
+
+	Layer* l = &layers[layerCapture];
+	layerCapture = -1;
+	if (l->failed)
+		return;
+
+	if (!l->vao)
 	{
-		// Draw circle as segmented arcs
-		ArcSlice(fx, fy, mag, mag, 0.0f, stepSz, steps);
+		glGenVertexArrays(1, &l->vao);
+		glGenBuffers(1, &l->vbo);
+		glGenBuffers(1, &l->ibo);
 	}
-	else
+
+	glBindVertexArray(l->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, l->vbo);
+	EnableAttributes();
+	if (instanced)
 	{
-		// Draw whole circle in a single loop
-		uint16_t base = drawListVertNum;
-		drawListVerts[drawListVertNum] = (vertex){fx + mag, fy};
-		drawListIndices[drawListCount++] = drawListVertNum++;
-		for (int i = 1; i < steps; ++i)
+		const GLsizeiptr segSize = l->count / 2 * (GLsizeiptr)sizeof(segment);
+		glBufferData(GL_ARRAY_BUFFER, segSize, NULL, GL_STATIC_DRAW);
+		segment* segs = glMapBufferRange(GL_ARRAY_BUFFER, 0, segSize,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (segs)
 		{
-			const float theta = stepSz * (float)i;
-			float ofsx = cosf(theta) * mag;
-			float ofsy = sinf(theta) * mag;
-
-			drawListVerts[drawListVertNum] = (vertex){fx + ofsx, fy + ofsy};
-			drawListIndices[drawListCount++] = drawListVertNum;
-			drawListIndices[drawListCount++] = drawListVertNum++;
+			ExpandSegments(segs, l->verts, l->indices, l->count);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		else
+		{
+			l->failed = true;
 		}
-		drawListIndices[drawListCount++] = base;
+		SetSegmentFormat(0);
 	}
+	else
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, l->ibo);
+		glBufferData(GL_ARRAY_BUFFER, l->vertNum * (GLsizeiptr)sizeof(vertex), l->verts, GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, l->count * (GLsizeiptr)sizeof(uint32_t), l->indices, GL_STATIC_DRAW);
+		SetVertexFormat();
+	}
+
+	// Restore draw list bindings
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vtxStream.buf);
+
+	l->valid = !l->failed;
 }
 
-void DrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
+static void BackendDrawLayer(int layer)
 {
-	if (drawColour != colour)
-		UpdateDrawColour();
+	const Layer* l = &layers[layer];
+	if (!l->valid || !l->count)
+		return;
 
-	const float mag = (float)r;
-	const float fstart = (float)startAng * (float)DEG2RAD;
-	const float fstepSz = (float)(endAng - startAng) / (float)abs(steps) * (float)DEG2RAD;
-	ArcSlice((float)x, (float)y, mag, mag, fstart, fstepSz, steps);
+	FlushDrawBuffers();
+	glBindVertexArray(l->vao);
+	if (instanced)
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 8, l->count / 2);
+	else
+		glDrawElements(GL_LINES, l->count, GL_UNSIGNED_INT, (GLvoid*)0);
+	glBindVertexArray(vao);
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+}
+
+static bool BackendIsDrawLayerValid(int layer)
+{
+	return layers[layer].valid;
 }
 
-void DrawPresent(void)
+static void BackendInvalidateDrawLayers(void)
+{
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+		layers[i].valid = false;
+}
+
+static void BackendDrawPresent(void)
 {
 	FlushDrawBuffers();
+	if (capRunning)
+	{
+		TRACE_BEGIN("capture");
+		CaptureFrame();
+		TRACE_END();
+	}
+	TRACE_BEGIN("swap");
 	SDL_GL_SwapWindow(window);
-#ifndef NDEBUG
-	//fprintf(stderr, "%d draw call(s)\n", drawCount);
-#endif
-	drawCount = 0;
+	TRACE_END();
 }
+
+const DrawBackend drawBackendGLCore =
+{
+	.name                 = "glcore",
+	.windowFlags          = SDL_WINDOW_OPENGL,
+	.windowHints          = BackendWindowHints,
+	.init                 = BackendInit,
+	.quit                 = BackendQuit,
+	.getDrawSize          = BackendGetDrawSize,
+	.setDrawViewport      = BackendSetDrawViewport,
+	.setDrawColour        = BackendSetDrawColour,
+	.drawClear            = BackendDrawClear,
+	.drawPoint            = BackendDrawPoint,
+	.drawRect             = BackendDrawRect,
+	.drawLines            = BackendDrawLines,
+	.drawCircleSteps      = BackendDrawCircleSteps,
+	.drawArcSteps         = BackendDrawArcSteps,
+	.drawArcAnalytic      = BackendDrawArcAnalytic,
+	.beginDrawLayer       = BackendBeginDrawLayer,
+	.endDrawLayer         = BackendEndDrawLayer,
+	.drawLayer            = BackendDrawLayer,
+	.isDrawLayerValid     = BackendIsDrawLayerValid,
+	.invalidateDrawLayers = BackendInvalidateDrawLayers,
+	.drawPresent          = BackendDrawPresent
+};
@@ -0,0 +1,38 @@
+#version 330 core
+
+in vec2 vLocal;
+flat in float vRadius;
+flat in vec2 vAngles;
+flat in vec4 vColour;
+
+out vec4 outColour;
+
+// Same falloff as the line shaders, which offset by half pixel units
+const float widthCoef = 1.0;
+const float aaCoef = 1.5;
+const float innerPx = widthCoef * 0.5;
+const float outerPx = (widthCoef + aaCoef) * 0.5;
+
+const float tau = 6.28318530718;
+
+void main()
+{
+	float dist = length(vLocal);
+	float ring = abs(dist - vRadius);
+	float alpha = clamp((outerPx - ring) / (outerPx - innerPx), 0.0, 1.0);
+
+	// Fade out past the ends of an arc, angles run anticlockwise on screen
+	if (vAngles.y < tau)
+	{
+		float theta = mod(atan(-vLocal.y, vLocal.x) - vAngles.x, tau);
+		if (theta > vAngles.y)
+		{
+			float outside = min(theta - vAngles.y, tau - theta) * dist;
+			alpha *= clamp(1.0 - outside, 0.0, 1.0);
+		}
+	}
+
+	if (alpha <= 0.0)
+		discard;
+	outColour = vec4(vColour.rgb, vColour.a * alpha);
+}
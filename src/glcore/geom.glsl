@@ -3,9 +3,10 @@
 layout (lines) in;
 layout (triangle_strip, max_vertices = 8) out;
 
+in vec4 gColour[];
+
 out vec4 vColour;
 
-uniform vec4 uColour;
 uniform vec2 uScaleFact;
 
 const float widthCoef = 1.0;
@@ -19,28 +20,33 @@ void main()
 	vec4 tangent = vec4(normal.yx * vec2(1.0, -1.0) * uScaleFact, 0.0, 0.0);
 
 	const float cumulCoef = widthCoef + aaCoef;
-	vec4 edgeColour = uColour * vec4(1.0, 1.0, 1.0, 0.0);
+	const vec4 edgeMask = vec4(1.0, 1.0, 1.0, 0.0);
 
-	vColour = edgeColour;
+	vColour = gColour[0] * edgeMask;
 	gl_Position = from - tangent * cumulCoef;
 	EmitVertex();
+	vColour = gColour[1] * edgeMask;
 	gl_Position = to - tangent * cumulCoef;
 	EmitVertex();
 
-	vColour = uColour;
+	vColour = gColour[0];
 	gl_Position = from - tangent * widthCoef;
 	EmitVertex();
+	vColour = gColour[1];
 	gl_Position = to - tangent * widthCoef;
 	EmitVertex();
 
+	vColour = gColour[0];
 	gl_Position = from + tangent * widthCoef;
 	EmitVertex();
+	vColour = gColour[1];
 	gl_Position = to + tangent * widthCoef;
 	EmitVertex();
 
-	vColour = edgeColour;
+	vColour = gColour[0] * edgeMask;
 	gl_Position = from + tangent * cumulCoef;
 	EmitVertex();
+	vColour = gColour[1] * edgeMask;
 	gl_Position = to + tangent * cumulCoef;
 	EmitVertex();
 }
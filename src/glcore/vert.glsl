@@ -1,10 +1,14 @@
 #version 330 core
 
 in vec2 inPos;
+in vec4 inColour;
+
+out vec4 gColour;
 
 uniform mat4 uView;
 
 void main()
 {
 	gl_Position = uView * vec4(inPos, 0.0, 1.0);
+	gColour = inColour;
 }
@@ -0,0 +1,30 @@
+#version 330 core
+
+// Each instance is a circle or arc drawn as a single quad, the ring itself
+// is evaluated in frag_arc.glsl
+in vec3 inCircle; // Centre & radius in pixels
+in vec2 inAngles; // Start & span in radians
+in vec4 inColour;
+
+out vec2 vLocal;
+flat out float vRadius;
+flat out vec2 vAngles;
+flat out vec4 vColour;
+
+uniform mat4 uView;
+
+const vec2 corners[4] = vec2[4](
+	vec2(-1.0, -1.0), vec2(1.0, -1.0),
+	vec2(-1.0,  1.0), vec2(1.0,  1.0));
+
+void main()
+{
+	// Pad the quad to fit the antialiased outer edge
+	float extent = inCircle.z + 2.0;
+	vLocal = corners[gl_VertexID] * extent;
+	gl_Position = uView * vec4(inCircle.xy + vLocal, 0.0, 1.0);
+
+	vRadius = inCircle.z;
+	vAngles = inAngles;
+	vColour = inColour;
+}
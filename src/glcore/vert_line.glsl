@@ -0,0 +1,37 @@
+#version 330 core
+
+// Instanced alternative to geom.glsl, each instance is a line segment
+// expanded into the same 8 vertex triangle strip
+in vec2 inFrom;
+in vec2 inTo;
+in vec4 inFromColour;
+in vec4 inToColour;
+
+out vec4 vColour;
+
+uniform mat4 uView;
+uniform vec2 uScaleFact;
+
+const float widthCoef = 1.0;
+const float aaCoef = 1.5;
+
+// Offsets of each pair of strip vertices from the line
+const float rowOffset[4] = float[4](
+	-(widthCoef + aaCoef), -widthCoef, widthCoef, widthCoef + aaCoef);
+
+void main()
+{
+	vec4 from = uView * vec4(inFrom, 0.0, 1.0);
+	vec4 to = uView * vec4(inTo, 0.0, 1.0);
+	vec2 normal = normalize(to.xy - from.xy);
+	vec4 tangent = vec4(normal.yx * vec2(1.0, -1.0) * uScaleFact, 0.0, 0.0);
+
+	// Even vertices sit at the start of the line, odd ones at the end
+	int row = gl_VertexID >> 1;
+	bool end = (gl_VertexID & 1) != 0;
+
+	gl_Position = (end ? to : from) + tangent * rowOffset[row];
+	vColour = end ? inToColour : inFromColour;
+	if (row == 0 || row == 3)
+		vColour.a = 0.0;
+}
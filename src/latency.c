@@ -0,0 +1,107 @@
+#include "latency.h"
+#include "util.h"
+#include <SDL_timer.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+typedef struct
+{
+	unsigned window[LATENCY_BINS]; // Counts of the samples in the ring
+	uint64_t total[LATENCY_BINS];  // Counts of every sample ever recorded
+	uint16_t ring[LATENCY_WINDOW]; // Bin of each sample in the window
+	unsigned head, count;
+} Histogram;
+
+static Histogram histograms[NUM_LATENCY_STAGES];
+static double usPerTick = 0.0;
+
+
+uint64_t LatencyEventTime(uint32_t timestamp)
+{
+	const uint64_t now = SDL_GetPerformanceCounter();
+	const uint64_t age = (uint64_t)(uint32_t)(SDL_GetTicks() - timestamp)
+		* SDL_GetPerformanceFrequency() / 1000;
+	return age < now ? now - age : 1;
+}
+
+void LatencyRecord(LatencyStage stage, uint64_t inputTime, uint64_t now)
+{
+	if (usPerTick == 0.0)
+		usPerTick = 1e6 / (double)SDL_GetPerformanceFrequency();
+
+	const double us = now > inputTime ? (double)(now - inputTime) * usPerTick : 0.0;
+	const uint16_t bin = (uint16_t)MIN((unsigned)(us / LATENCY_BIN_US), LATENCY_BINS - 1);
+
+	Histogram* h = &histograms[stage];
+	if (h->count == LATENCY_WINDOW)
+		--h->window[h->ring[h->head]];
+	else
+		++h->count;
+	h->ring[h->head] = bin;
+	h->head = (h->head + 1) % LATENCY_WINDOW;
+	++h->window[bin];
+	++h->total[bin];
+}
+
+static double Percentile(const Histogram* h, double p)
+{
+	// Nearest rank, reported at the middle of the bin
+	const unsigned rank = MAX(1u, (unsigned)(p * (double)h->count + 0.999999));
+	unsigned sum = 0;
+	for (int i = 0; i < LATENCY_BINS; ++i)
+		if ((sum += h->window[i]) >= rank)
+			return ((double)i + 0.5) * LATENCY_BIN_US / 1000.0;
+	return 0.0;
+}
+
+LatencySummary GetLatencySummary(LatencyStage stage)
+{
+	const Histogram* h = &histograms[stage];
+	if (!h->count)
+		return (LatencySummary){0, 0.0, 0.0, 0.0};
+	return (LatencySummary){
+		h->count,
+		Percentile(h, 0.50),
+		Percentile(h, 0.95),
+		Percentile(h, 0.99)};
+}
+
+const char* LatencyStageName(LatencyStage stage)
+{
+	switch (stage)
+	{
+	case (LATENCY_PRESENT): return "present";
+	case (LATENCY_SWAP):    return "swap";
+	default: return "unknown";
+	}
+}
+
+int LatencyWriteCSV(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return -1;
+
+	fprintf(file, "latency_ms");
+	for (int s = 0; s < NUM_LATENCY_STAGES; ++s)
+		fprintf(file, ",%s", LatencyStageName((LatencyStage)s));
+	fprintf(file, "\n");
+
+	// One row per non-empty bin, labelled by its lower bound
+	for (int i = 0; i < LATENCY_BINS; ++i)
+	{
+		bool empty = true;
+		for (int s = 0; s < NUM_LATENCY_STAGES; ++s)
+			empty &= histograms[s].total[i] == 0;
+		if (empty)
+			continue;
+
+		fprintf(file, "%.1f", (double)i * LATENCY_BIN_US / 1000.0);
+		for (int s = 0; s < NUM_LATENCY_STAGES; ++s)
+			fprintf(file, ",%llu", (unsigned long long)histograms[s].total[i]);
+		fprintf(file, "\n");
+	}
+
+	const bool failed = ferror(file) != 0;
+	return (fclose(file) || failed) ? -1 : 0;
+}
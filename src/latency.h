@@ -0,0 +1,49 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#define LATENCY_BIN_US 100  // Histogram bin width in microseconds
+#define LATENCY_BINS   1000 // Number of bins, the last one holds every slower sample
+#define LATENCY_WINDOW 512  // Samples the rolling percentiles are taken over
+
+typedef enum
+{
+	LATENCY_PRESENT, // Input to the point the frame is handed to DrawPresent
+	LATENCY_SWAP,    // Input to DrawPresent returning
+	NUM_LATENCY_STAGES
+} LatencyStage;
+
+typedef struct
+{
+	unsigned count;      // Samples in the rolling window
+	double p50, p95, p99; // Rolling percentiles in milliseconds
+} LatencySummary;
+
+// Convert an SDL event timestamp to a performance counter value.
+//
+// Event timestamps are only millisecond precise, so the time the event
+// spent queued is measured in milliseconds & taken off the current count.
+uint64_t LatencyEventTime(uint32_t timestamp);
+
+// Add a latency sample.
+//
+// Params:
+//   stage     - Point in the frame that was reached.
+//   inputTime - Performance counter value the input was timestamped at.
+//   now       - Performance counter value at that point.
+void LatencyRecord(LatencyStage stage, uint64_t inputTime, uint64_t now);
+
+// Get the rolling percentiles of a stage.
+LatencySummary GetLatencySummary(LatencyStage stage);
+
+// Get a human readable stage name.
+const char* LatencyStageName(LatencyStage stage);
+
+// Write the histograms of every sample recorded so far as CSV.
+//
+// Returns:
+//   0 on success, -1 if the file couldn't be written.
+int LatencyWriteCSV(const char* path);
+
+#endif//LATENCY_H
@@ -2,6 +2,7 @@
 #define MATHS_H
 
 #include <math.h>
+#include <stdint.h>
 
 #define PI  3.141592653589793238462643383279502884L
 #define TAU 6.283185307179586476925286766559005768L
@@ -22,6 +23,40 @@ static inline vector VecScale(vector v, vec_t x)
 	return (vector){v.x * x, v.y * x};
 }
 
+static inline vector VecLerp(vector a, vector b, vec_t t)
+{
+	return (vector){a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+}
+
+// Q16.16 fixed point
+typedef int32_t fixed_t;
+typedef struct { fixed_t x, y; } fxvector;
+
+#define FX_SHIFT 16
+#define FX_ONE   (1 << FX_SHIFT)
+
+static inline fixed_t FxFromDouble(double x)
+{
+	return (fixed_t)lround(x * (double)FX_ONE);
+}
+
+static inline double FxToDouble(fixed_t x)
+{
+	return (double)x / (double)FX_ONE;
+}
+
+// Convert a raw SDL axis value to fixed point, matching value / 0x7FFF.
+static inline fixed_t FxFromAxis(int16_t value)
+{
+	// round(2^32 / 0x7FFF), the product is at most 2^33 so fits easily
+	return (fixed_t)(((int64_t)value * 131076 + (1 << 15)) >> 16);
+}
+
+static inline fixed_t FxMul(fixed_t a, fixed_t b)
+{
+	return (fixed_t)(((int64_t)a * (int64_t)b) >> FX_SHIFT);
+}
+
 static inline double pfmod(double x, double d)
 {
 	return fmod(fmod(x, d) + d, (d));
@@ -1,7 +1,11 @@
 #include "draw.h"
+#include "draw_backend.h"
+#include "counters.h"
+#include "trace.h"
 #include "metal_shader_types.h"
 #include "metalShader.h"
 #include "maths.h"
+#include "tessellate.h"
 #include <SDL_metal.h>
 
 #import <Metal/Metal.h>
@@ -25,6 +29,11 @@
 - (uint16_t) queueVertex:(float)x :(float)y;
 - (uint16_t) queueIndex:(uint16_t)idx;
 - (void) queueIndices:(uint16_t*)idcs count:(unsigned)count;
+- (void) beginLayer:(int)layer;
+- (void) endLayer;
+- (void) drawLayer:(int)layer;
+- (BOOL) isLayerValid:(int)layer;
+- (void) invalidateLayers;
 - (void) present;
 
 @end
@@ -46,6 +55,14 @@
 
 	unsigned _vtxListCount, _vtxListReserve, _idxListCount, _idxListReserve;
 	id<MTLBuffer> _vtxMtlBuffer, _idxMtlBuffer;
+
+	// Retained layers are copied out of the draw list when captured and
+	// copied back in each time they're drawn
+	NSMutableData* _layerVtx[MAX_DRAW_LAYERS];
+	NSMutableData* _layerIdx[MAX_DRAW_LAYERS];
+	BOOL _layerValid[MAX_DRAW_LAYERS];
+	int _layerCapture;
+	unsigned _layerVtxStart, _layerIdxStart;
 }
 
 - (id) init:(SDL_Window*)window
@@ -58,6 +75,7 @@
 	_idxListReserve = 0;
 	_vtxMtlBuffer = nil;
 	_idxMtlBuffer = nil;
+	_layerCapture = -1;
 
 	// Create Metal view
 	_window = window;
@@ -124,6 +142,11 @@
 
 - (void) dealloc
 {
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+	{
+		[_layerVtx[i] release];
+		[_layerIdx[i] release];
+	}
 	SDL_Metal_DestroyView(_view);
 	[super dealloc];
 }
@@ -229,6 +252,86 @@
 	_idxListCount += count;
 }
 
+- (void) beginLayer:(int)layer
+{
+	_layerValid[layer] = NO;
+	_layerCapture = layer;
+	_layerVtxStart = _vtxListCount;
+	_layerIdxStart = _idxListCount;
+}
+
+- (void) endLayer
+{
+	if (_layerCapture < 0)
+		return;
+
+	const int layer = _layerCapture;
+	const unsigned numVtx = _vtxListCount - _layerVtxStart;
+	const unsigned numIdx = _idxListCount - _layerIdxStart;
+	if (!_layerVtx[layer])
+	{
+		_layerVtx[layer] = [[NSMutableData alloc] init];
+		_layerIdx[layer] = [[NSMutableData alloc] init];
+	}
+	[_layerVtx[layer] setLength:numVtx * sizeof(ShaderVertex)];
+	[_layerIdx[layer] setLength:numIdx * sizeof(uint16_t)];
+
+	if (numVtx && numIdx)
+	{
+		memcpy(_layerVtx[layer].mutableBytes,
+			&((ShaderVertex*)_vtxMtlBuffer.contents)[_layerVtxStart],
+			numVtx * sizeof(ShaderVertex));
+
+		// Store indices relative to the start of the layer
+		const uint16_t* src = &((uint16_t*)_idxMtlBuffer.contents)[_layerIdxStart];
+		uint16_t* dst = _layerIdx[layer].mutableBytes;
+		for (unsigned i = 0; i < numIdx; ++i)
+			dst[i] = src[i] - (uint16_t)_layerVtxStart;
+	}
+
+	// Roll back the draw list, captured geometry is only drawn by drawLayer
+	_vtxListCount = _layerVtxStart;
+	_idxListCount = _layerIdxStart;
+	_layerValid[layer] = YES;
+	_layerCapture = -1;
+}
+
+- (void) drawLayer:(int)layer
+{
+	if (!_layerValid[layer])
+		return;
+
+	const unsigned numVtx = (unsigned)(_layerVtx[layer].length / sizeof(ShaderVertex));
+	const unsigned numIdx = (unsigned)(_layerIdx[layer].length / sizeof(uint16_t));
+	if (!numVtx || !numIdx)
+		return;
+
+	[self reserveVertices:numVtx];
+	[self reserveIndices:numIdx];
+
+	const uint16_t base = (uint16_t)_vtxListCount;
+	memcpy(&((ShaderVertex*)_vtxMtlBuffer.contents)[_vtxListCount],
+		_layerVtx[layer].bytes, numVtx * sizeof(ShaderVertex));
+	_vtxListCount += numVtx;
+
+	const uint16_t* src = _layerIdx[layer].bytes;
+	uint16_t* dst = &((uint16_t*)_idxMtlBuffer.contents)[_idxListCount];
+	for (unsigned i = 0; i < numIdx; ++i)
+		dst[i] = src[i] + base;
+	_idxListCount += numIdx;
+}
+
+- (BOOL) isLayerValid:(int)layer
+{
+	return _layerValid[layer];
+}
+
+- (void) invalidateLayers
+{
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+		_layerValid[i] = NO;
+}
+
 - (void) present
 {
 	// Synchronise buffers
@@ -255,6 +358,10 @@
 			[enc drawIndexedPrimitives:MTLPrimitiveTypeLine
 				indexCount:_idxListCount indexType:MTLIndexTypeUInt16
 				indexBuffer:_idxMtlBuffer indexBufferOffset:0];
+			CounterAdd(COUNTER_DRAW_CALLS, 1);
+			CounterAdd(COUNTER_FLUSHES, 1);
+			CounterAdd(COUNTER_VERTICES, _vtxListCount);
+			CounterAdd(COUNTER_INDICES, _idxListCount);
 
 			_vtxListCount = 0;
 			_idxListCount = 0;
@@ -271,9 +378,11 @@
 
 static MetalRenderer* renderer = nil;
 
-void DrawWindowHints(void) {}
+static void BackendDrawCircleSteps(int x, int y, int r, int steps);
+
+static void BackendWindowHints(void) {}
 
-int InitDraw(SDL_Window* window)
+static int BackendInit(SDL_Window* window)
 {
 	renderer = [[MetalRenderer alloc] init:window];
 	if (!renderer)
@@ -283,43 +392,44 @@ int InitDraw(SDL_Window* window)
 }
 
 
-void QuitDraw(void)
+static void BackendQuit(void)
 {
 	[renderer release];
+	renderer = nil;
 }
 
 
-size GetDrawSizeInPixels(void)
+static size BackendGetDrawSize(void)
 {
 	return renderer ? [renderer getDrawSize] : (size){ 0, 0 };
 }
 
 
-void SetDrawViewport(size size)
+static void BackendSetDrawViewport(size size)
 {
 	[renderer setView:size];
 }
 
 
-void SetDrawColour(uint32_t c)
+static void BackendSetDrawColour(uint32_t c)
 {
 	renderer.drawColour = c;
 }
 
 
-void DrawClear(void)
+static void BackendDrawClear(void)
 {
 	[renderer clear];
 }
 
 
-void DrawPoint(int x, int y)
+static void BackendDrawPoint(int x, int y)
 {
-	DrawCircleSteps(x, y, 1, 4);
+	BackendDrawCircleSteps(x, y, 1, 4);
 }
 
 
-void DrawRect(int x, int y, int w, int h)
+static void BackendDrawRect(int x, int y, int w, int h)
 {
 	[renderer reserveVertices:4];
 	vector_float2
@@ -334,53 +444,124 @@ void DrawRect(int x, int y, int w, int h)
 }
 
 
-void DrawLine(int x1, int y1, int x2, int y2)
+static void BackendDrawLines(const point* points, int count)
 {
-	[renderer queueIndex:[renderer queueVertex:x1 :y1]];
-	[renderer queueIndex:[renderer queueVertex:x2 :y2]];
+	if (count < 2)
+		return;
+
+	[renderer reserveVertices:count];
+	[renderer reserveIndices:(count - 1) * 2];
+	[renderer queueIndex:[renderer queueVertex:points[0].x :points[0].y]];
+	for (int i = 1; i < count - 1; ++i)
+	{
+		uint16_t ii = [renderer queueVertex:points[i].x :points[i].y];
+		[renderer queueIndices:(uint16_t[]){ ii, ii } count:2];
+	}
+	[renderer queueIndex:[renderer queueVertex:points[count - 1].x :points[count - 1].y]];
 }
 
 
-void DrawCircleSteps(int x, int y, int r, int steps)
+static void BackendDrawCircleSteps(int x, int y, int r, int steps)
 {
+	const tessvec* unit = GetUnitArc(360, steps);
+	if (!unit)
+		return;
 	const float fx = (float)x, fy = (float)y;
-	const float stepSz = (float)TAU / (float)abs(steps);
 	const float mag = (float)r;
 
 	// Draw whole circle in a single loop
 	[renderer reserveVertices:steps];
 	[renderer reserveIndices:steps * 2];
-	uint16_t base = [renderer queueIndex:[renderer queueVertex:fx + mag :fy]];
+	uint16_t base = [renderer queueIndex:[renderer queueVertex:fx + unit[0].x * mag :fy + unit[0].y * mag]];
 	for (int i = 1; i < steps; ++i)
 	{
-		const float theta = stepSz * (float)i;
-		uint16_t ii = [renderer queueVertex:fx + cosf(theta) * mag :fy + sinf(theta) * mag];
+		uint16_t ii = [renderer queueVertex:fx + unit[i].x * mag :fy + unit[i].y * mag];
 		[renderer queueIndices:(uint16_t[]){ ii, ii } count:2];
 	}
 	[renderer queueIndex:base];
 }
 
 
-void DrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
+static void BackendDrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
 {
+	const tessvec* unit = GetUnitArc(endAng - startAng, steps);
+	if (!unit)
+		return;
 	const float fx = (float)x, fy = (float)y;
 	const float magw = (float)r, magh = (float)r;
+	const tessvec dir = GetUnitDirection(startAng);
 
-	const float start = (float)startAng * (float)DEG2RAD;
-	const float stepSz = (float)(endAng - startAng) / (float)abs(steps) * (float)DEG2RAD;
-	[renderer reserveVertices:steps];
+	[renderer reserveVertices:steps + 1];
 	[renderer reserveIndices:steps * 2];
-	uint16_t ii = [renderer queueVertex:fx + cosf(start) * magw :fy - sinf(start) * magh];
+	tessvec ofs = TessRotate(unit[0], dir);
+	uint16_t ii = [renderer queueVertex:fx + ofs.x * magw :fy + ofs.y * magh];
 	for (int i = 1; i <= steps; ++i)
 	{
-		const float theta = start + stepSz * (float)i;
-		uint16_t iii = [renderer queueVertex:fx + cosf(theta) * magw :fy - sinf(theta) * magh];
+		ofs = TessRotate(unit[i], dir);
+		uint16_t iii = [renderer queueVertex:fx + ofs.x * magw :fy + ofs.y * magh];
 		[renderer queueIndices:(uint16_t[]){ ii, iii } count:2];
 		ii = iii;
 	}
 }
 
-void DrawPresent(void)
+static bool BackendDrawArcAnalytic(int x, int y, int r, int startAng, int endAng)
 {
+	return false;
+}
+
+static void BackendBeginDrawLayer(int layer, rect bounds)
+{
+	[renderer beginLayer:layer];
+}
+
+static void BackendEndDrawLayer(void)
+{
+	[renderer endLayer];
+}
+
+static void BackendDrawLayer(int layer)
+{
+	[renderer drawLayer:layer];
+}
+
+static bool BackendIsDrawLayerValid(int layer)
+{
+	return [renderer isLayerValid:layer];
+}
+
+static void BackendInvalidateDrawLayers(void)
+{
+	[renderer invalidateLayers];
+}
+
+static void BackendDrawPresent(void)
+{
+	TRACE_BEGIN("swap");
 	[renderer present];
+	TRACE_END();
 }
+
+const DrawBackend drawBackendMetal =
+{
+	.name                 = "metal",
+	.windowFlags          = SDL_WINDOW_METAL,
+	.windowHints          = BackendWindowHints,
+	.init                 = BackendInit,
+	.quit                 = BackendQuit,
+	.getDrawSize          = BackendGetDrawSize,
+	.setDrawViewport      = BackendSetDrawViewport,
+	.setDrawColour        = BackendSetDrawColour,
+	.drawClear            = BackendDrawClear,
+	.drawPoint            = BackendDrawPoint,
+	.drawRect             = BackendDrawRect,
+	.drawLines            = BackendDrawLines,
+	.drawCircleSteps      = BackendDrawCircleSteps,
+	.drawArcSteps         = BackendDrawArcSteps,
+	.drawArcAnalytic      = BackendDrawArcAnalytic,
+	.beginDrawLayer       = BackendBeginDrawLayer,
+	.endDrawLayer         = BackendEndDrawLayer,
+	.drawLayer            = BackendDrawLayer,
+	.isDrawLayerValid     = BackendIsDrawLayerValid,
+	.invalidateDrawLayers = BackendInvalidateDrawLayers,
+	.drawPresent          = BackendDrawPresent
+};
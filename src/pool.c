@@ -0,0 +1,233 @@
+#include "pool.h"
+#include "util.h"
+#include "trace.h"
+#include <SDL_atomic.h>
+#include <SDL_cpuinfo.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Range of indices left to a worker, guarded by its lock as both the
+// owner (taking from the front) & thieves (taking from the back) modify it
+typedef struct
+{
+	SDL_SpinLock lock;
+	int begin, end;
+} Share;
+
+typedef struct
+{
+	Pool* pool;
+	int self;
+} Worker;
+
+// Workers sleep on 'wake' until the generation changes, the last one to
+// finish a run signals 'done'. The generation, busy & quit are guarded by
+// the mutex, the rest is only written while the workers are asleep.
+struct Pool
+{
+	Share* shares;
+	Worker* workers;
+	SDL_Thread** handles;
+	int numShares;
+	SDL_mutex* mutex;
+	SDL_cond* wake;
+	SDL_cond* done;
+	unsigned generation;
+	int busy;
+	bool quit;
+	PoolJob job;
+	void* ctx;
+};
+
+
+int PoolDefaultThreads(void)
+{
+	return MAX(SDL_GetCPUCount(), 1);
+}
+
+static bool TakeFront(Share* share, int* out)
+{
+	SDL_AtomicLock(&share->lock);
+	const bool have = share->begin < share->end;
+	if (have)
+		*out = share->begin++;
+	SDL_AtomicUnlock(&share->lock);
+	return have;
+}
+
+// Move the back half of the fullest other share into ours.
+static bool Steal(Pool* pool, int self)
+{
+	// Sizes can change once unlocked, so the victim is rechecked below
+	int victim = -1, most = 0;
+	for (int i = 0; i < pool->numShares; ++i)
+	{
+		if (i == self)
+			continue;
+		Share* share = &pool->shares[i];
+		SDL_AtomicLock(&share->lock);
+		const int left = share->end - share->begin;
+		SDL_AtomicUnlock(&share->lock);
+		if (left > most)
+		{
+			victim = i;
+			most = left;
+		}
+	}
+	if (victim < 0)
+		return false;
+
+	Share* from = &pool->shares[victim];
+	Share* to = &pool->shares[self];
+	SDL_AtomicLock(&from->lock);
+	const int left = from->end - from->begin;
+	const int take = (left + 1) / 2;
+	const int end = from->end;
+	from->end -= take;
+	SDL_AtomicUnlock(&from->lock);
+
+	// Ours is empty & nobody steals from an empty share, but lock anyway
+	// so the update is published to other workers
+	SDL_AtomicLock(&to->lock);
+	to->begin = end - take;
+	to->end = end;
+	SDL_AtomicUnlock(&to->lock);
+	return true;
+}
+
+static void RunShare(Pool* pool, int self)
+{
+	Share* share = &pool->shares[self];
+	int index;
+	do
+	{
+		while (TakeFront(share, &index))
+			pool->job(pool->ctx, index);
+	}
+	while (Steal(pool, self));
+}
+
+static int SDLCALL WorkerMain(void* data)
+{
+	const Worker* worker = data;
+	Pool* pool = worker->pool;
+	TRACE_THREAD("pool", worker->self);
+
+	unsigned seen = 0;
+	SDL_LockMutex(pool->mutex);
+	for (;;)
+	{
+		while (pool->generation == seen && !pool->quit)
+			SDL_CondWait(pool->wake, pool->mutex);
+		if (pool->quit)
+			break;
+		seen = pool->generation;
+		SDL_UnlockMutex(pool->mutex);
+
+		RunShare(pool, worker->self);
+
+		SDL_LockMutex(pool->mutex);
+		if (--pool->busy == 0)
+			SDL_CondSignal(pool->done);
+	}
+	SDL_UnlockMutex(pool->mutex);
+	return 0;
+}
+
+Pool* PoolCreate(int threads)
+{
+	threads = MAX(threads, 1);
+	Pool* pool = calloc(1, sizeof(Pool));
+	if (!pool)
+		return NULL;
+	pool->shares = calloc((size_t)threads, sizeof(Share));
+	pool->workers = calloc((size_t)threads, sizeof(Worker));
+	pool->handles = calloc((size_t)threads, sizeof(SDL_Thread*));
+	pool->mutex = SDL_CreateMutex();
+	pool->wake = SDL_CreateCond();
+	pool->done = SDL_CreateCond();
+	pool->numShares = 1;
+	if (!pool->shares || !pool->workers || !pool->handles || !pool->mutex || !pool->wake || !pool->done)
+	{
+		PoolDestroy(pool);
+		return NULL;
+	}
+
+	// Workers that fail to start are left out, the caller always runs share 0
+	for (int i = 1; i < threads; ++i)
+	{
+		const int self = pool->numShares;
+		pool->workers[self] = (Worker){pool, self};
+		if ((pool->handles[self] = SDL_CreateThread(WorkerMain, "pool", &pool->workers[self])) != NULL)
+			++pool->numShares;
+	}
+	return pool;
+}
+
+void PoolDestroy(Pool* pool)
+{
+	if (!pool)
+		return;
+	if (pool->mutex)
+	{
+		SDL_LockMutex(pool->mutex);
+		pool->quit = true;
+		SDL_CondBroadcast(pool->wake);
+		SDL_UnlockMutex(pool->mutex);
+	}
+	for (int i = 1; i < pool->numShares; ++i)
+		SDL_WaitThread(pool->handles[i], NULL);
+
+	if (pool->done)
+		SDL_DestroyCond(pool->done);
+	if (pool->wake)
+		SDL_DestroyCond(pool->wake);
+	if (pool->mutex)
+		SDL_DestroyMutex(pool->mutex);
+	free(pool->shares);
+	free(pool->workers);
+	free(pool->handles);
+	free(pool);
+}
+
+int PoolThreads(const Pool* pool)
+{
+	return pool->numShares;
+}
+
+void PoolRun(Pool* pool, int count, PoolJob job, void* ctx)
+{
+	if (count <= 0)
+		return;
+
+	// Workers are all asleep between runs, so the shares are ours to set
+	const int threads = pool->numShares;
+	for (int i = 0; i < threads; ++i)
+	{
+		pool->shares[i].begin = (int)((long long)count * i / threads);
+		pool->shares[i].end = (int)((long long)count * (i + 1) / threads);
+	}
+	pool->job = job;
+	pool->ctx = ctx;
+
+	if (threads > 1)
+	{
+		SDL_LockMutex(pool->mutex);
+		pool->busy = threads - 1;
+		++pool->generation;
+		SDL_CondBroadcast(pool->wake);
+		SDL_UnlockMutex(pool->mutex);
+	}
+
+	RunShare(pool, 0);
+
+	if (threads > 1)
+	{
+		SDL_LockMutex(pool->mutex);
+		while (pool->busy)
+			SDL_CondWait(pool->done, pool->mutex);
+		SDL_UnlockMutex(pool->mutex);
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Job function, called once for every index of a run.
+typedef void (*PoolJob)(void* ctx, int index);
+
+// A set of worker threads kept waiting between runs.
+typedef struct Pool Pool;
+
+// Get the number of worker threads to use by default, one per CPU core.
+int PoolDefaultThreads(void);
+
+// Start the worker threads of a pool.
+//
+// Params:
+//   threads - Number of workers, the thread calling PoolRun being one of
+//             them. Fewer are used if some can't be started.
+//
+// Returns:
+//   The pool, or NULL if out of memory.
+Pool* PoolCreate(int threads);
+
+// Stop the worker threads & wait for them to exit.
+//
+// This is safe to call with NULL.
+void PoolDestroy(Pool* pool);
+
+// Get the number of workers, including the calling thread.
+int PoolThreads(const Pool* pool);
+
+// Run a job for every index in [0, count) across the workers of a pool.
+//
+// Each worker starts with an equal contiguous share of the indices & takes
+// them from the front, once out of work it steals the back half of the
+// largest remaining share. Indices may run in any order & concurrently,
+// the call returns once all of them are done.
+//
+// Must only be called from one thread at a time.
+//
+// Params:
+//   count - Number of indices to run.
+//   job   - Job function, must be safe to call from several threads.
+//   ctx   - Passed through to the job function.
+void PoolRun(Pool* pool, int count, PoolJob job, void* ctx);
+
+#endif//POOL_H
@@ -0,0 +1,188 @@
+#include "record.h"
+#include <SDL_timer.h>
+#include <string.h>
+#include <limits.h>
+
+// Trace layout, all fields little-endian:
+//   header: "PLTR", u16 version, u16 record size, u64 reserved
+//   record: u64 time (ns), s32 device, u8 axis, u8 reserved, s16 value
+#define TRACE_MAGIC "PLTR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+#define TRACE_RECORD_SIZE 16
+#define RECORD_BUFFER_SIZE (TRACE_RECORD_SIZE * 4096)
+
+static FILE* recFile = NULL;
+static uint64_t recStart = 0;
+static double recNsPerTick = 0.0;
+
+static FILE* playFile = NULL;
+static InputRecord playNext;
+static bool playHasNext = false, playStepped = false;
+static uint64_t playStart = 0, playLimit = 0;
+static double playNsPerTick = 0.0, playSpeed = 1.0;
+
+
+static inline void PutLE(uint8_t* out, uint64_t v, int n)
+{
+	for (int i = 0; i < n; ++i)
+		out[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline uint64_t GetLE(const uint8_t* in, int n)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < n; ++i)
+		v |= (uint64_t)in[i] << (8 * i);
+	return v;
+}
+
+
+int RecordOpen(const char* path)
+{
+	RecordClose();
+	if ((recFile = fopen(path, "wb")) == NULL)
+		return -1;
+	setvbuf(recFile, NULL, _IOFBF, RECORD_BUFFER_SIZE);
+
+	uint8_t header[TRACE_HEADER_SIZE] = {0};
+	memcpy(header, TRACE_MAGIC, 4);
+	PutLE(&header[4], TRACE_VERSION, 2);
+	PutLE(&header[6], TRACE_RECORD_SIZE, 2);
+	if (fwrite(header, TRACE_HEADER_SIZE, 1, recFile) != 1)
+	{
+		RecordClose();
+		return -1;
+	}
+
+	recStart = SDL_GetPerformanceCounter();
+	recNsPerTick = 1e9 / (double)SDL_GetPerformanceFrequency();
+	return 0;
+}
+
+void RecordAxisAt(int32_t device, uint8_t axis, int16_t value, uint64_t counter)
+{
+	if (!recFile)
+		return;
+
+	const uint64_t time = counter > recStart ? (uint64_t)((double)(counter - recStart) * recNsPerTick) : 0;
+	uint8_t record[TRACE_RECORD_SIZE];
+	PutLE(&record[0], time, 8);
+	PutLE(&record[8], (uint32_t)device, 4);
+	record[12] = axis;
+	record[13] = 0;
+	PutLE(&record[14], (uint16_t)value, 2);
+	fwrite(record, TRACE_RECORD_SIZE, 1, recFile);
+}
+
+void RecordClose(void)
+{
+	if (recFile)
+		fclose(recFile);
+	recFile = NULL;
+}
+
+
+FILE* OpenTrace(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return NULL;
+	setvbuf(file, NULL, _IOFBF, RECORD_BUFFER_SIZE);
+
+	uint8_t header[TRACE_HEADER_SIZE];
+	if (fread(header, TRACE_HEADER_SIZE, 1, file) != 1
+		|| memcmp(header, TRACE_MAGIC, 4)
+		|| GetLE(&header[4], 2) != TRACE_VERSION
+		|| GetLE(&header[6], 2) != TRACE_RECORD_SIZE)
+	{
+		fprintf(stderr, "\"%s\" is not a valid input trace\n", path);
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+bool ReadRecord(FILE* file, InputRecord* out)
+{
+	uint8_t record[TRACE_RECORD_SIZE];
+	if (fread(record, TRACE_RECORD_SIZE, 1, file) != 1)
+		return false;
+
+	out->time   = GetLE(&record[0], 8);
+	out->device = (int32_t)(uint32_t)GetLE(&record[8], 4);
+	out->axis   = record[12];
+	out->value  = (int16_t)(uint16_t)GetLE(&record[14], 2);
+	return true;
+}
+
+
+static uint64_t ReplayElapsed(void)
+{
+	return (uint64_t)((double)(SDL_GetPerformanceCounter() - playStart) * playNsPerTick);
+}
+
+int ReplayOpen(const char* path, double speed)
+{
+	ReplayClose();
+	if ((playFile = OpenTrace(path)) == NULL)
+		return -1;
+
+	playHasNext = ReadRecord(playFile, &playNext);
+	playStepped = speed <= 0.0;
+	playSpeed = speed;
+	playLimit = 0;
+	playStart = SDL_GetPerformanceCounter();
+	playNsPerTick = playStepped ? 0.0 : 1e9 / (double)SDL_GetPerformanceFrequency() * speed;
+	ReplayStep();
+	return 0;
+}
+
+bool ReplayPoll(InputRecord* out)
+{
+	if (!playHasNext)
+		return false;
+
+	const uint64_t limit = playStepped ? playLimit : ReplayElapsed();
+	if (playNext.time > limit)
+		return false;
+
+	*out = playNext;
+	playHasNext = ReadRecord(playFile, &playNext);
+	return true;
+}
+
+void ReplayStep(void)
+{
+	if (playStepped && playHasNext)
+		playLimit = playNext.time;
+}
+
+int ReplayTimeout(void)
+{
+	if (!playHasNext)
+		return -1;
+	if (playStepped)
+		return 0;
+
+	const uint64_t elapsed = ReplayElapsed();
+	if (playNext.time <= elapsed)
+		return 0;
+
+	// Round up so we never wake before the record is due
+	const uint64_t wait = (uint64_t)((double)(playNext.time - elapsed) / playSpeed / 1e6) + 1;
+	return wait > INT_MAX ? INT_MAX : (int)wait;
+}
+
+bool ReplayFinished(void)
+{
+	return playFile != NULL && !playHasNext;
+}
+
+void ReplayClose(void)
+{
+	if (playFile)
+		fclose(playFile);
+	playFile = NULL;
+	playHasNext = false;
+}
@@ -0,0 +1,80 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Device id used for stick positions entered with the mouse on a panel
+// without a controller.
+#define RECORD_DEVICE_MOUSE -1
+
+// A single axis sample, stored on disk as 16 little-endian bytes.
+typedef struct
+{
+	uint64_t time;  // Nanoseconds since the recording started
+	int32_t device; // SDL joystick instance id or RECORD_DEVICE_MOUSE
+	uint8_t axis;   // SDL_GameControllerAxis
+	int16_t value;  // Raw axis value as reported by SDL
+} InputRecord;
+
+// Start recording axis samples to a trace file.
+//
+// Returns:
+//   0 on success, -1 if the file couldn't be created.
+int RecordOpen(const char* path);
+
+// Append an axis sample taken at an earlier time.
+//
+// Does nothing if no recording is open.
+//
+// Params:
+//   counter - SDL performance counter value the sample was taken at.
+void RecordAxisAt(int32_t device, uint8_t axis, int16_t value, uint64_t counter);
+
+// Flush & close the current recording, if any.
+void RecordClose(void);
+
+
+// Open a trace file for replay.
+//
+// Params:
+//   speed - Playback rate multiplier, 1.0 being real time.
+//           A rate of 0 steps through the trace one timestamp
+//           per call to ReplayStep regardless of wall time.
+//
+// Returns:
+//   0 on success, -1 if the file couldn't be opened or isn't a trace.
+int ReplayOpen(const char* path, double speed);
+
+// Get the next record that is due for playback.
+//
+// Returns:
+//   true and fills 'out' if a record is due, false otherwise.
+bool ReplayPoll(InputRecord* out);
+
+// Allow the next timestamp through in stepped (speed 0) playback.
+void ReplayStep(void);
+
+// Milliseconds until the next record is due, -1 if none remain.
+int ReplayTimeout(void);
+
+// True once every record has been played back.
+bool ReplayFinished(void);
+
+// Close the replay file, if any.
+void ReplayClose(void);
+
+// Open a trace for reading & verify its header.
+//
+// Returns:
+//   File handle positioned at the first record, NULL on failure.
+FILE* OpenTrace(const char* path);
+
+// Read the next record from a trace opened with OpenTrace.
+//
+// Returns:
+//   true on success, false at the end of the file.
+bool ReadRecord(FILE* file, InputRecord* out);
+
+#endif//RECORD_H
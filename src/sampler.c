@@ -0,0 +1,169 @@
+#include "sampler.h"
+#include "util.h"
+#include "trace.h"
+#include <SDL.h>
+
+#define SAMPLER_MASK (SAMPLER_RING_SIZE - 1)
+
+static const SDL_GameControllerAxis sampledAxes[] =
+{
+	SDL_CONTROLLER_AXIS_LEFTX,  SDL_CONTROLLER_AXIS_LEFTY,
+	SDL_CONTROLLER_AXIS_RIGHTX, SDL_CONTROLLER_AXIS_RIGHTY
+};
+#define NUM_SAMPLED_AXES (sizeof(sampledAxes) / sizeof(*sampledAxes))
+
+// Single producer, single consumer ring, head is only written by the
+// sampler thread & tail only by the consumer. The indices run freely &
+// are masked on access. SDL_AtomicSet is only an acquire barrier on some
+// platforms, so explicit barriers order the slot accesses against the
+// index updates: release before publishing an index, acquire after
+// reading the other side's.
+static AxisSample ring[SAMPLER_RING_SIZE];
+static SDL_atomic_t head, tail, dropped;
+
+static SDL_Thread* thread = NULL;
+static SDL_atomic_t running;
+static SDL_GameController* samplePads[SAMPLER_MAX_PADS];
+static int32_t sampleIds[SAMPLER_MAX_PADS];
+static int samplePadCount = 0;
+static double samplePeriod = 0.0;
+static uint32_t wakeEvent = 0;
+
+
+static void Push(const AxisSample* sample)
+{
+	const unsigned h = (unsigned)SDL_AtomicGet(&head);
+	const unsigned t = (unsigned)SDL_AtomicGet(&tail);
+	SDL_MemoryBarrierAcquire();
+	if (h - t >= SAMPLER_RING_SIZE)
+	{
+		SDL_AtomicAdd(&dropped, 1);
+		return;
+	}
+	ring[h & SAMPLER_MASK] = *sample;
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&head, (int)(h + 1));
+
+	// Wake the consumer on the first sample after it caught up
+	if (h == t && wakeEvent)
+	{
+		SDL_Event event = {0};
+		event.type = wakeEvent;
+		SDL_PushEvent(&event);
+	}
+}
+
+static int SDLCALL SamplerThread(void* data)
+{
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+	TRACE_THREAD("sampler", 0);
+
+	const uint64_t freq = SDL_GetPerformanceFrequency();
+	const uint64_t period = MAX((uint64_t)(samplePeriod * (double)freq), 1);
+	uint64_t deadline = SDL_GetPerformanceCounter();
+
+	int16_t last[SAMPLER_MAX_PADS][NUM_SAMPLED_AXES];
+	bool first = true;
+	while (SDL_AtomicGet(&running))
+	{
+		int16_t values[SAMPLER_MAX_PADS][NUM_SAMPLED_AXES];
+		TRACE_BEGIN("poll");
+		SDL_LockJoysticks();
+		SDL_GameControllerUpdate();
+		for (int j = 0; j < samplePadCount; ++j)
+			for (size_t i = 0; i < NUM_SAMPLED_AXES; ++i)
+				values[j][i] = SDL_GameControllerGetAxis(samplePads[j], sampledAxes[i]);
+		SDL_UnlockJoysticks();
+		TRACE_END();
+
+		const uint64_t now = SDL_GetPerformanceCounter();
+		for (int j = 0; j < samplePadCount; ++j)
+		{
+			for (size_t i = 0; i < NUM_SAMPLED_AXES; ++i)
+			{
+				if (!first && values[j][i] == last[j][i])
+					continue;
+				Push(&(AxisSample){now, sampleIds[j], (uint8_t)sampledAxes[i], values[j][i]});
+				last[j][i] = values[j][i];
+			}
+		}
+		first = false;
+
+		// Resync instead of bursting if we fell more than a period behind
+		deadline += period;
+		if (now > deadline + period)
+			deadline = now + period;
+		const uint64_t wait = deadline > now ? (deadline - now) * 1000 / freq : 0;
+		SDL_Delay((Uint32)MAX(wait, 1));
+	}
+	return 0;
+}
+
+int SamplerStart(SDL_GameController* const* pads, const int32_t* ids, int count, double rate)
+{
+	SamplerStop();
+	if (count < 1 || rate <= 0.0)
+		return -1;
+
+	if (!wakeEvent)
+	{
+		const Uint32 type = SDL_RegisterEvents(1);
+		wakeEvent = type != (Uint32)-1 ? type : 0;
+	}
+
+	samplePadCount = MIN(count, SAMPLER_MAX_PADS);
+	for (int i = 0; i < samplePadCount; ++i)
+	{
+		samplePads[i] = pads[i];
+		sampleIds[i] = ids[i];
+	}
+	samplePeriod = 1.0 / rate;
+	SDL_AtomicSet(&head, 0);
+	SDL_AtomicSet(&tail, 0);
+	SDL_AtomicSet(&running, 1);
+	thread = SDL_CreateThread(SamplerThread, "sampler", NULL);
+	if (!thread)
+	{
+		SDL_AtomicSet(&running, 0);
+		return -1;
+	}
+	return 0;
+}
+
+void SamplerStop(void)
+{
+	if (!thread)
+		return;
+	SDL_AtomicSet(&running, 0);
+	SDL_WaitThread(thread, NULL);
+	thread = NULL;
+	samplePadCount = 0;
+}
+
+bool SamplerRunning(void)
+{
+	return thread != NULL;
+}
+
+size_t SamplerDrain(AxisSample* out, size_t max)
+{
+	const unsigned t = (unsigned)SDL_AtomicGet(&tail);
+	const unsigned h = (unsigned)SDL_AtomicGet(&head);
+	SDL_MemoryBarrierAcquire();
+	const size_t count = MIN((size_t)(h - t), max);
+	for (size_t i = 0; i < count; ++i)
+		out[i] = ring[(t + (unsigned)i) & SAMPLER_MASK];
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&tail, (int)(t + (unsigned)count));
+	return count;
+}
+
+unsigned SamplerDropped(void)
+{
+	return (unsigned)SDL_AtomicGet(&dropped);
+}
+
+uint32_t SamplerWakeEvent(void)
+{
+	return wakeEvent;
+}
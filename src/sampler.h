@@ -0,0 +1,66 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Capacity of the sample ring, must be a power of two.
+#define SAMPLER_RING_SIZE 4096
+// Most controllers sampled at once, as many as analogue.c shows.
+#define SAMPLER_MAX_PADS 8
+
+typedef struct _SDL_GameController SDL_GameController;
+
+// A controller axis value read by the sampler thread.
+typedef struct
+{
+	uint64_t time;  // Performance counter value when sampled
+	int32_t device; // SDL joystick instance id
+	uint8_t axis;   // SDL_GameControllerAxis
+	int16_t value;  // Raw axis value as reported by SDL
+} AxisSample;
+
+// Start polling the stick axes of a set of controllers on a background
+// thread, replacing any that were being sampled before.
+//
+// Samples are only produced when an axis changes, starting with the
+// current state of every axis. When the consumer has caught up, the first
+// new sample also pushes a wake event so a blocked event loop notices it.
+// Sleeps use SDL_Delay, which limits the effective rate to about 1 kHz.
+//
+// Params:
+//   pads  - Controllers to sample, must stay open until SamplerStop.
+//   ids   - Joystick instance id of each controller.
+//   count - Number of controllers, at most SAMPLER_MAX_PADS.
+//   rate  - Polls per second.
+//
+// Returns:
+//   0 on success, -1 if there is nothing to sample or the thread
+//   couldn't be started.
+int SamplerStart(SDL_GameController* const* pads, const int32_t* ids, int count, double rate);
+
+// Stop the sampler thread & wait for it to exit.
+//
+// Samples still in the ring can be drained until the next SamplerStart,
+// which discards them.
+void SamplerStop(void);
+
+// True while the sampler thread is running.
+bool SamplerRunning(void);
+
+// Take samples out of the ring in the order they were produced.
+//
+// Must only be called from a single consumer thread.
+//
+// Returns:
+//   Number of samples written to 'out', at most 'max'.
+size_t SamplerDrain(AxisSample* out, size_t max);
+
+// Get the number of samples dropped because the ring was full.
+unsigned SamplerDropped(void);
+
+// Get the SDL event type pushed to wake the consumer, 0 if unavailable.
+uint32_t SamplerWakeEvent(void);
+
+#endif//SAMPLER_H
@@ -0,0 +1,632 @@
+#include "draw.h"
+#include "draw_backend.h"
+#include "counters.h"
+#include "trace.h"
+#include "maths.h"
+#include "tessellate.h"
+#include "pool.h"
+#include "span.h"
+#include <SDL_render.h>
+#include <SDL_video.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Width & height of a binning tile in pixels
+#define TILE_SIZE 64
+
+// Same falloff as the GL core line shaders, in pixels from the line centre
+#define AA_INNER 0.5f
+#define AA_OUTER 1.25f
+#define AA_SCALE (1.0f / (AA_OUTER - AA_INNER))
+
+typedef enum
+{
+	CMD_CLEAR,
+	CMD_LINE,
+	CMD_ARC
+} CmdType;
+
+typedef struct
+{
+	CmdType type;
+	uint32_t colour;            // Packed pixel, premultiplied unless clearing
+	float x1, y1, x2, y2;       // Line end points, or arc centre & radius in x2
+	float start, span;          // Arc start & span in radians, a full turn or more for circles
+	int minx, miny, maxx, maxy; // Inclusive pixel bounds
+} Cmd;
+
+typedef struct
+{
+	Cmd* cmds;
+	int num, cap;
+} CmdList;
+
+// Indices of the frame's commands that touch a tile, in submission order
+typedef struct
+{
+	int* cmds;
+	int num, cap;
+} Bin;
+
+static SDL_Renderer* rend = NULL; // Left NULL when running headless
+static SDL_Window* window = NULL;
+static SDL_Texture* texture = NULL;
+static uint32_t* pixels = NULL;
+static size fbSize = {0, 0};
+static Pool* pool = NULL;
+
+static uint32_t colour = 0, clearColour = 0;
+static bool invisible = true; // Draw colour is fully transparent
+
+// Draw calls are recorded into the frame's command list & rasterised at
+// present, split into tiles that are rasterised in parallel
+static CmdList frame;
+static Bin* bins = NULL;
+static int* busyTiles = NULL;
+static int tilesX = 0, tilesY = 0;
+
+// Retained layers are command lists appended to the frame when drawn
+static CmdList layers[MAX_DRAW_LAYERS];
+static bool layerValid[MAX_DRAW_LAYERS];
+static int layerCapture = -1;
+static bool layerFailed = false;
+
+static bool Reserve(void** data, int* cap, int need, size_t elemSize)
+{
+	if (need <= *cap)
+		return true;
+	int newCap = MAX(*cap * 2, MAX(need, 256));
+	void* tmp = realloc(*data, (size_t)newCap * elemSize);
+	if (!tmp)
+		return false;
+	*data = tmp;
+	*cap = newCap;
+	return true;
+}
+
+static void PushCmd(const Cmd* cmd)
+{
+	CmdList* list = layerCapture >= 0 ? &layers[layerCapture] : &frame;
+	if (!Reserve((void**)&list->cmds, &list->cap, list->num + 1, sizeof(Cmd)))
+	{
+		layerFailed |= layerCapture >= 0;
+		return;
+	}
+	list->cmds[list->num++] = *cmd;
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+}
+
+static void PushLine(float x1, float y1, float x2, float y2)
+{
+	if (invisible)
+		return;
+	PushCmd(&(Cmd){
+		.type = CMD_LINE, .colour = colour,
+		.x1 = x1, .y1 = y1, .x2 = x2, .y2 = y2,
+		.minx = (int)floorf(MIN(x1, x2) - AA_OUTER),
+		.miny = (int)floorf(MIN(y1, y2) - AA_OUTER),
+		.maxx = (int)floorf(MAX(x1, x2) + AA_OUTER),
+		.maxy = (int)floorf(MAX(y1, y2) + AA_OUTER) });
+}
+
+// Integer coordinates are positioned at pixel centres
+static inline void PushLineInt(int x1, int y1, int x2, int y2)
+{
+	PushLine(
+		(float)x1 + 0.5f, (float)y1 + 0.5f,
+		(float)x2 + 0.5f, (float)y2 + 0.5f);
+}
+
+
+static inline uint8_t ToCoverage(float alpha)
+{
+	return (uint8_t)(SATURATE(alpha) * 255.0f + 0.5f);
+}
+
+// Distance from a point to a line segment, relative to its first point
+static inline float SegmentDistance(float fx, float fy, float dx, float dy, float invLen2)
+{
+	const float t = SATURATE((fx * dx + fy * dy) * invLen2);
+	const float ex = fx - t * dx, ey = fy - t * dy;
+	return sqrtf(ex * ex + ey * ey);
+}
+
+static void RasterLine(const Cmd* c, const SDL_Rect* tile)
+{
+	const float dx = c->x2 - c->x1, dy = c->y2 - c->y1;
+	const float len2 = dx * dx + dy * dy;
+	const float len = sqrtf(len2);
+	const float invLen2 = len2 > 0.0f ? 1.0f / len2 : 0.0f;
+
+	// Rows are narrowed to the band around the line unless it's near horizontal
+	const bool band = fabsf(dy) > 1e-3f * len;
+	const float invNx = band ? -len / dy : 0.0f;
+	const float ny = len > 0.0f ? dx / len : 0.0f;
+
+	const int y0 = MAX(c->miny, tile->y), y1 = MIN(c->maxy, tile->y + tile->h - 1);
+	uint8_t cov[TILE_SIZE];
+	for (int y = y0; y <= y1; ++y)
+	{
+		const float py = (float)y + 0.5f;
+		int xs = MAX(c->minx, tile->x), xe = MIN(c->maxx, tile->x + tile->w - 1);
+		if (band)
+		{
+			// Solve |(p - p1) . n| <= outer for the pixel centres on this row
+			const float base = (py - c->y1) * ny;
+			float a = c->x1 + (-AA_OUTER - base) * invNx;
+			float b = c->x1 + (AA_OUTER - base) * invNx;
+			if (a > b)
+			{
+				const float tmp = a;
+				a = b;
+				b = tmp;
+			}
+			xs = MAX(xs, (int)floorf(a - 0.5f));
+			xe = MIN(xe, (int)ceilf(b - 0.5f));
+		}
+		if (xs > xe)
+			continue;
+
+		const float fy = py - c->y1;
+		for (int x = xs; x <= xe; ++x)
+		{
+			const float d = SegmentDistance((float)x + 0.5f - c->x1, fy, dx, dy, invLen2);
+			cov[x - xs] = ToCoverage((AA_OUTER - d) * AA_SCALE);
+		}
+		SpanBlend(&pixels[y * fbSize.w + xs], cov, xe - xs + 1, c->colour);
+	}
+}
+
+static inline uint8_t ArcCoverage(const Cmd* c, float dx, float dy, bool partial)
+{
+	const float dist = sqrtf(dx * dx + dy * dy);
+	float alpha = (AA_OUTER - fabsf(dist - c->x2)) * AA_SCALE;
+
+	// Fade out past the ends of an arc, angles run anticlockwise on screen
+	if (partial && alpha > 0.0f)
+	{
+		float theta = fmodf(atan2f(-dy, dx) - c->start, (float)TAU);
+		if (theta < 0.0f)
+			theta += (float)TAU;
+		if (theta > c->span)
+		{
+			const float outside = MIN(theta - c->span, (float)TAU - theta) * dist;
+			alpha *= SATURATE(1.0f - outside);
+		}
+	}
+	return ToCoverage(alpha);
+}
+
+static void RasterArc(const Cmd* c, const SDL_Rect* tile)
+{
+	const float ro = c->x2 + AA_OUTER, ri = c->x2 - AA_OUTER;
+	const bool partial = c->span < (float)TAU;
+
+	const int y0 = MAX(c->miny, tile->y), y1 = MIN(c->maxy, tile->y + tile->h - 1);
+	const int xmin = MAX(c->minx, tile->x), xmax = MIN(c->maxx, tile->x + tile->w - 1);
+	uint8_t cov[TILE_SIZE];
+	for (int y = y0; y <= y1; ++y)
+	{
+		const float dy = (float)y + 0.5f - c->y1;
+		if (fabsf(dy) > ro)
+			continue;
+
+		// One run across the ring, or one either side of the hole in its middle
+		const float wo = sqrtf(ro * ro - dy * dy);
+		const float wi = ri > 0.0f && fabsf(dy) < ri ? sqrtf(ri * ri - dy * dy) : -1.0f;
+		const float runs[2][2] =
+		{
+			{ c->x1 - wo, wi < 0.0f ? c->x1 + wo : c->x1 - wi },
+			{ c->x1 + wi, c->x1 + wo }
+		};
+
+		int last = xmin - 1;
+		for (int i = 0; i < (wi < 0.0f ? 1 : 2); ++i)
+		{
+			const int xs = MAX(MAX(xmin, last + 1), (int)floorf(runs[i][0] - 0.5f));
+			const int xe = MIN(xmax, (int)ceilf(runs[i][1] - 0.5f));
+			if (xs > xe)
+				continue;
+			for (int x = xs; x <= xe; ++x)
+				cov[x - xs] = ArcCoverage(c, (float)x + 0.5f - c->x1, dy, partial);
+			SpanBlend(&pixels[y * fbSize.w + xs], cov, xe - xs + 1, c->colour);
+			last = xe;
+		}
+	}
+}
+
+static SDL_Rect TileRect(int tile)
+{
+	const int x = (tile % tilesX) * TILE_SIZE;
+	const int y = (tile / tilesX) * TILE_SIZE;
+	return (SDL_Rect){x, y, MIN(TILE_SIZE, fbSize.w - x), MIN(TILE_SIZE, fbSize.h - y)};
+}
+
+static void RasterTile(void* ctx, int index)
+{
+	TRACE_BEGIN("tile");
+	const int tile = busyTiles[index];
+	const SDL_Rect rect = TileRect(tile);
+	const Bin* bin = &bins[tile];
+	for (int i = 0; i < bin->num; ++i)
+	{
+		const Cmd* c = &frame.cmds[bin->cmds[i]];
+		switch (c->type)
+		{
+		case CMD_CLEAR:
+			for (int y = rect.y; y < rect.y + rect.h; ++y)
+				SpanFill(&pixels[y * fbSize.w + rect.x], rect.w, c->colour);
+			break;
+		case CMD_LINE:
+			RasterLine(c, &rect);
+			break;
+		case CMD_ARC:
+			RasterArc(c, &rect);
+			break;
+		}
+	}
+	TRACE_END();
+}
+
+// Conservative test for a command covering any pixel of a tile
+static bool TouchesTile(const Cmd* c, const SDL_Rect* tile)
+{
+	const float hw = (float)tile->w * 0.5f, hh = (float)tile->h * 0.5f;
+	const float cx = (float)tile->x + hw, cy = (float)tile->y + hh;
+	if (c->type == CMD_LINE)
+	{
+		const float dx = c->x2 - c->x1, dy = c->y2 - c->y1;
+		const float len2 = dx * dx + dy * dy;
+		const float d = SegmentDistance(cx - c->x1, cy - c->y1, dx, dy, len2 > 0.0f ? 1.0f / len2 : 0.0f);
+		return d <= sqrtf(hw * hw + hh * hh) + AA_OUTER;
+	}
+
+	// Skip tiles entirely inside or outside of the ring
+	const float nx = MAX(fabsf(c->x1 - cx) - hw, 0.0f), ny = MAX(fabsf(c->y1 - cy) - hh, 0.0f);
+	const float fx = fabsf(c->x1 - cx) + hw, fy = fabsf(c->y1 - cy) + hh;
+	const float nearest = sqrtf(nx * nx + ny * ny), farthest = sqrtf(fx * fx + fy * fy);
+	return nearest <= c->x2 + AA_OUTER && farthest >= c->x2 - AA_OUTER;
+}
+
+static void BinPush(Bin* bin, int cmd)
+{
+	if (Reserve((void**)&bin->cmds, &bin->cap, bin->num + 1, sizeof(int)))
+		bin->cmds[bin->num++] = cmd;
+}
+
+static int BinCommands(void)
+{
+	const int numTiles = tilesX * tilesY;
+	for (int i = 0; i < numTiles; ++i)
+		bins[i].num = 0;
+
+	for (int i = 0; i < frame.num; ++i)
+	{
+		const Cmd* c = &frame.cmds[i];
+		if (c->type == CMD_CLEAR)
+		{
+			// Nothing drawn before a clear can show through it
+			for (int j = 0; j < numTiles; ++j)
+			{
+				bins[j].num = 0;
+				BinPush(&bins[j], i);
+			}
+			continue;
+		}
+		if (c->maxx < 0 || c->maxy < 0 || c->minx >= fbSize.w || c->miny >= fbSize.h)
+			continue;
+
+		const int tx0 = MAX(c->minx, 0) / TILE_SIZE, tx1 = MIN(c->maxx, fbSize.w - 1) / TILE_SIZE;
+		const int ty0 = MAX(c->miny, 0) / TILE_SIZE, ty1 = MIN(c->maxy, fbSize.h - 1) / TILE_SIZE;
+		for (int ty = ty0; ty <= ty1; ++ty)
+		{
+			for (int tx = tx0; tx <= tx1; ++tx)
+			{
+				const int tile = ty * tilesX + tx;
+				const SDL_Rect rect = TileRect(tile);
+				if (TouchesTile(c, &rect))
+					BinPush(&bins[tile], i);
+			}
+		}
+	}
+
+	int busy = 0;
+	for (int i = 0; i < numTiles; ++i)
+		if (bins[i].num)
+			busyTiles[busy++] = i;
+	return busy;
+}
+
+static void FreeBins(void)
+{
+	for (int i = 0; i < tilesX * tilesY; ++i)
+		free(bins[i].cmds);
+	free(bins);
+	free(busyTiles);
+	bins = NULL;
+	busyTiles = NULL;
+	tilesX = tilesY = 0;
+}
+
+static int ResizeFramebuffer(size want)
+{
+	if (pixels && want.w == fbSize.w && want.h == fbSize.h)
+		return 0;
+
+	FreeBins();
+	free(pixels);
+	pixels = NULL;
+	if (texture)
+		SDL_DestroyTexture(texture);
+	texture = NULL;
+	fbSize = (size){0, 0};
+	if (want.w <= 0 || want.h <= 0)
+		return 0;
+
+	const int numTiles = ((want.w + TILE_SIZE - 1) / TILE_SIZE) * ((want.h + TILE_SIZE - 1) / TILE_SIZE);
+	pixels = calloc((size_t)want.w * (size_t)want.h, sizeof(uint32_t));
+	bins = calloc((size_t)numTiles, sizeof(Bin));
+	busyTiles = calloc((size_t)numTiles, sizeof(int));
+	if (!pixels || !bins || !busyTiles)
+		goto error;
+	if (rend)
+	{
+		texture = SDL_CreateTexture(rend, SDL_PIXELFORMAT_RGBA32,
+			SDL_TEXTUREACCESS_STREAMING, want.w, want.h);
+		if (!texture)
+			goto error;
+	}
+
+	fbSize = want;
+	tilesX = (want.w + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (want.h + TILE_SIZE - 1) / TILE_SIZE;
+	return 0;
+
+error:
+	free(pixels);
+	free(bins);
+	free(busyTiles);
+	pixels = NULL;
+	bins = NULL;
+	busyTiles = NULL;
+	return -1;
+}
+
+
+static size BackendGetDrawSize(void);
+static void BackendInvalidateDrawLayers(void);
+
+static void BackendWindowHints(void) {}
+
+static int BackendInit(SDL_Window* w)
+{
+	window = w;
+	if (window == NULL)
+		return -1;
+
+	// Headless rasterises every frame but never shows it
+	const char* env = getenv("PADLAB_SOFT_HEADLESS");
+	const bool headless = env && strcmp(env, "") && strcmp(env, "0");
+	if (!headless)
+	{
+		rend = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+		if (rend == NULL)
+			return -1;
+	}
+
+	env = getenv("PADLAB_SOFT_THREADS");
+	pool = PoolCreate(env && atoi(env) > 0 ? atoi(env) : PoolDefaultThreads());
+	if (pool == NULL)
+		return -1;
+	fprintf(stderr, "Rasterising on %d threads with %s spans%s\n",
+		PoolThreads(pool), GetSpanKernel(), headless ? ", headless" : "");
+
+	return ResizeFramebuffer(BackendGetDrawSize());
+}
+
+static void BackendQuit(void)
+{
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+	{
+		free(layers[i].cmds);
+		layers[i] = (CmdList){NULL, 0, 0};
+		layerValid[i] = false;
+	}
+	free(frame.cmds);
+	frame = (CmdList){NULL, 0, 0};
+	layerCapture = -1;
+
+	ResizeFramebuffer((size){0, 0});
+	PoolDestroy(pool);
+	pool = NULL;
+	if (rend)
+		SDL_DestroyRenderer(rend);
+	rend = NULL;
+	window = NULL;
+}
+
+
+static size BackendGetDrawSize(void)
+{
+	size out = {0, 0};
+	if (rend)
+		SDL_GetRendererOutputSize(rend, &out.w, &out.h);
+	else if (window)
+		SDL_GetWindowSize(window, &out.w, &out.h);
+	return out;
+}
+
+static void BackendSetDrawViewport(size size)
+{
+	BackendInvalidateDrawLayers();
+	if (ResizeFramebuffer(size))
+		fprintf(stderr, "Failed to allocate a %dx%d framebuffer\n", size.w, size.h);
+}
+
+
+static void BackendSetDrawColour(uint32_t c)
+{
+	colour = SpanPackColour(c, true);
+	clearColour = SpanPackColour(c, false);
+	invisible = (c & 0x000000FF) == 0;
+}
+
+static void BackendDrawClear(void)
+{
+	// Commands under a clear of the frame would never be seen
+	if (layerCapture < 0)
+		frame.num = 0;
+	PushCmd(&(Cmd){ .type = CMD_CLEAR, .colour = clearColour });
+}
+
+static void BackendDrawPoint(int x, int y)
+{
+	PushLine((float)x, (float)y + 0.5f, (float)x + 1.0f, (float)y + 0.5f);
+}
+
+static void BackendDrawRect(int x, int y, int w, int h)
+{
+	PushLineInt(x, y, x + w, y);
+	PushLineInt(x + w, y, x + w, y + h);
+	PushLineInt(x + w, y + h, x, y + h);
+	PushLineInt(x, y + h, x, y);
+}
+
+static void BackendDrawLines(const point* points, int count)
+{
+	for (int i = 1; i < count; ++i)
+		PushLineInt(points[i - 1].x, points[i - 1].y, points[i].x, points[i].y);
+}
+
+static void BackendDrawCircleSteps(int x, int y, int r, int steps)
+{
+	const tessvec* unit = GetUnitArc(360, steps);
+	if (!unit)
+		return;
+
+	const float cx = (float)x + 0.5f, cy = (float)y + 0.5f, mag = (float)r;
+	for (int i = 1; i <= steps; ++i)
+		PushLine(
+			cx + unit[i - 1].x * mag, cy + unit[i - 1].y * mag,
+			cx + unit[i].x * mag, cy + unit[i].y * mag);
+}
+
+static void BackendDrawArcSteps(int x, int y, int r, int startAng, int endAng, int steps)
+{
+	const tessvec* unit = GetUnitArc(endAng - startAng, steps);
+	if (!unit)
+		return;
+
+	const tessvec dir = GetUnitDirection(startAng);
+	const float cx = (float)x + 0.5f, cy = (float)y + 0.5f, mag = (float)r;
+	tessvec prev = TessRotate(unit[0], dir);
+	for (int i = 1; i <= steps; ++i)
+	{
+		const tessvec ofs = TessRotate(unit[i], dir);
+		PushLine(cx + prev.x * mag, cy + prev.y * mag, cx + ofs.x * mag, cy + ofs.y * mag);
+		prev = ofs;
+	}
+}
+
+static bool BackendDrawArcAnalytic(int x, int y, int r, int startAng, int endAng)
+{
+	if (invisible)
+		return true;
+
+	// Spans past a full turn skip the angle test
+	const int span = abs(endAng - startAng);
+	const float cx = (float)x + 0.5f, cy = (float)y + 0.5f;
+	const float extent = (float)r + AA_OUTER;
+	PushCmd(&(Cmd){
+		.type = CMD_ARC, .colour = colour,
+		.x1 = cx, .y1 = cy, .x2 = (float)r,
+		.start = (float)(MIN(startAng, endAng) * DEG2RAD),
+		.span = span >= 360 ? (float)TAU * 2.0f : (float)(span * DEG2RAD),
+		.minx = (int)floorf(cx - extent), .miny = (int)floorf(cy - extent),
+		.maxx = (int)floorf(cx + extent), .maxy = (int)floorf(cy + extent) });
+	return true;
+}
+
+static void BackendBeginDrawLayer(int layer, rect bounds)
+{
+	layers[layer].num = 0;
+	layerValid[layer] = layerFailed = false;
+	layerCapture = layer;
+}
+
+static void BackendEndDrawLayer(void)
+{
+	if (layerCapture < 0)
+		return;
+	layerValid[layerCapture] = !layerFailed;
+	layerCapture = -1;
+}
+
+static void BackendDrawLayer(int layer)
+{
+	const CmdList* l = &layers[layer];
+	if (!layerValid[layer] || !Reserve((void**)&frame.cmds, &frame.cap, frame.num + l->num, sizeof(Cmd)))
+		return;
+	memcpy(&frame.cmds[frame.num], l->cmds, (size_t)l->num * sizeof(Cmd));
+	frame.num += l->num;
+	CounterAdd(COUNTER_DRAW_CALLS, 1);
+}
+
+static bool BackendIsDrawLayerValid(int layer)
+{
+	return layerValid[layer];
+}
+
+static void BackendInvalidateDrawLayers(void)
+{
+	for (int i = 0; i < MAX_DRAW_LAYERS; ++i)
+		layerValid[i] = false;
+}
+
+static void BackendDrawPresent(void)
+{
+	if (pixels)
+	{
+		TRACE_BEGIN("flush");
+		const int busy = BinCommands();
+		PoolRun(pool, busy, RasterTile, NULL);
+		TRACE_END();
+		CounterAdd(COUNTER_FLUSHES, 1);
+	}
+	frame.num = 0;
+
+	if (texture)
+	{
+		TRACE_BEGIN("swap");
+		SDL_UpdateTexture(texture, NULL, pixels, fbSize.w * (int)sizeof(uint32_t));
+		SDL_RenderCopy(rend, texture, NULL, NULL);
+		SDL_RenderPresent(rend);
+		TRACE_END();
+	}
+}
+
+const DrawBackend drawBackendSoft =
+{
+	.name                 = "soft",
+	.windowFlags          = 0,
+	.windowHints          = BackendWindowHints,
+	.init                 = BackendInit,
+	.quit                 = BackendQuit,
+	.getDrawSize          = BackendGetDrawSize,
+	.setDrawViewport      = BackendSetDrawViewport,
+	.setDrawColour        = BackendSetDrawColour,
+	.drawClear            = BackendDrawClear,
+	.drawPoint            = BackendDrawPoint,
+	.drawRect             = BackendDrawRect,
+	.drawLines            = BackendDrawLines,
+	.drawCircleSteps      = BackendDrawCircleSteps,
+	.drawArcSteps         = BackendDrawArcSteps,
+	.drawArcAnalytic      = BackendDrawArcAnalytic,
+	.beginDrawLayer       = BackendBeginDrawLayer,
+	.endDrawLayer         = BackendEndDrawLayer,
+	.drawLayer            = BackendDrawLayer,
+	.isDrawLayerValid     = BackendIsDrawLayerValid,
+	.invalidateDrawLayers = BackendInvalidateDrawLayers,
+	.drawPresent          = BackendDrawPresent
+};
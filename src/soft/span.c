@@ -0,0 +1,226 @@
+#include "span.h"
+#include "util.h"
+#include <SDL_cpuinfo.h>
+#include <string.h>
+
+#if defined __x86_64__ || defined _M_X64 || defined __i386__ || defined _M_IX86
+ #define SPAN_X86
+ #include <immintrin.h>
+ #if defined __GNUC__ || defined __clang__
+  #define TARGET_SSE2 __attribute__((target("sse2")))
+  #define TARGET_AVX2 __attribute__((target("avx2")))
+ #else
+  #define TARGET_SSE2
+  #define TARGET_AVX2
+ #endif
+#endif
+
+typedef void (*SpanKernel)(uint32_t* dst, const uint8_t* coverage, int count, uint32_t colour);
+
+
+uint32_t SpanPackColour(uint32_t c, bool premult)
+{
+	uint8_t rgba[4] = {
+		(uint8_t)((c & 0xFF000000) >> 24),
+		(uint8_t)((c & 0x00FF0000) >> 16),
+		(uint8_t)((c & 0x0000FF00) >>  8),
+		(uint8_t)((c & 0x000000FF)) };
+	if (premult)
+		for (int i = 0; i < 3; ++i)
+			rgba[i] = (uint8_t)((rgba[i] * rgba[3] + 127) / 255);
+
+	uint32_t out;
+	memcpy(&out, rgba, sizeof(out));
+	return out;
+}
+
+void SpanFill(uint32_t* dst, int count, uint32_t colour)
+{
+	// Simple enough for the compiler to vectorise
+	for (int i = 0; i < count; ++i)
+		dst[i] = colour;
+}
+
+// Exact round(x / 255) for x up to 255 * 255
+static inline unsigned Div255(unsigned x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+// All kernels compute, per channel with premultiplied colour p & alpha a:
+//   s   = p * cov / 255
+//   out = s + dst * (255 - a * cov / 255) / 255
+// rounding each division the same way, so their output is bit identical.
+static void KernelScalar(uint32_t* dst, const uint8_t* coverage, int count, uint32_t colour)
+{
+	uint8_t p[4];
+	memcpy(p, &colour, sizeof(p));
+	for (int i = 0; i < count; ++i)
+	{
+		const unsigned cov = coverage[i];
+		if (!cov)
+			continue;
+		const unsigned inv = 255 - Div255(p[3] * cov);
+		uint8_t* d = (uint8_t*)&dst[i];
+		for (int j = 0; j < 4; ++j)
+			d[j] = (uint8_t)(Div255(p[j] * cov) + Div255(d[j] * inv));
+	}
+}
+
+#ifdef SPAN_X86
+TARGET_SSE2 static inline __m128i Div255SSE2(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Blend two pixels unpacked to 16 bits per channel
+TARGET_SSE2 static inline __m128i BlendSSE2(__m128i d, __m128i c, __m128i p)
+{
+	const __m128i s = Div255SSE2(_mm_mullo_epi16(p, c));
+	__m128i inv = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+	inv = _mm_sub_epi16(_mm_set1_epi16(255), inv);
+	return _mm_add_epi16(s, Div255SSE2(_mm_mullo_epi16(d, inv)));
+}
+
+TARGET_SSE2 static void KernelSSE2(uint32_t* dst, const uint8_t* coverage, int count, uint32_t colour)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i p = _mm_unpacklo_epi8(_mm_set1_epi32((int)colour), zero);
+	const __m128i solid = _mm_set1_epi32((int)colour);
+	const bool opaque = ((const uint8_t*)&colour)[3] == 0xFF;
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		uint32_t cov4;
+		memcpy(&cov4, &coverage[i], sizeof(cov4));
+		if (!cov4)
+			continue;
+		if (cov4 == 0xFFFFFFFF && opaque)
+		{
+			_mm_storeu_si128((__m128i*)&dst[i], solid);
+			continue;
+		}
+
+		// Spread each pixel's coverage over its four channels
+		__m128i c = _mm_cvtsi32_si128((int)cov4);
+		c = _mm_unpacklo_epi8(c, c);
+		c = _mm_unpacklo_epi16(c, c);
+
+		const __m128i d = _mm_loadu_si128((const __m128i*)&dst[i]);
+		const __m128i lo = BlendSSE2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(c, zero), p);
+		const __m128i hi = BlendSSE2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(c, zero), p);
+		_mm_storeu_si128((__m128i*)&dst[i], _mm_packus_epi16(lo, hi));
+	}
+	KernelScalar(&dst[i], &coverage[i], count - i, colour);
+}
+
+TARGET_AVX2 static inline __m256i Div255AVX2(__m256i x)
+{
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+TARGET_AVX2 static inline __m256i BlendAVX2(__m256i d, __m256i c, __m256i p)
+{
+	const __m256i s = Div255AVX2(_mm256_mullo_epi16(p, c));
+	__m256i inv = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+	inv = _mm256_sub_epi16(_mm256_set1_epi16(255), inv);
+	return _mm256_add_epi16(s, Div255AVX2(_mm256_mullo_epi16(d, inv)));
+}
+
+TARGET_AVX2 static void KernelAVX2(uint32_t* dst, const uint8_t* coverage, int count, uint32_t colour)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i solid = _mm256_set1_epi32((int)colour);
+	const __m256i p = _mm256_unpacklo_epi8(solid, zero);
+	const __m256i spread = _mm256_setr_epi8(
+		0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12,
+		0, 0, 0, 0, 4, 4, 4, 4, 8, 8, 8, 8, 12, 12, 12, 12);
+	const bool opaque = ((const uint8_t*)&colour)[3] == 0xFF;
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		uint64_t cov8;
+		memcpy(&cov8, &coverage[i], sizeof(cov8));
+		if (!cov8)
+			continue;
+		if (cov8 == UINT64_MAX && opaque)
+		{
+			_mm256_storeu_si256((__m256i*)&dst[i], solid);
+			continue;
+		}
+
+		// One coverage byte per pixel, then spread over its four channels
+		const __m256i c = _mm256_shuffle_epi8(
+			_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&coverage[i])), spread);
+
+		// Unpacks work within 128-bit lanes, packing undoes them in the same order
+		const __m256i d = _mm256_loadu_si256((const __m256i*)&dst[i]);
+		const __m256i lo = BlendAVX2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(c, zero), p);
+		const __m256i hi = BlendAVX2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(c, zero), p);
+		_mm256_storeu_si256((__m256i*)&dst[i], _mm256_packus_epi16(lo, hi));
+	}
+	KernelSSE2(&dst[i], &coverage[i], count - i, colour);
+}
+
+static bool HasSSE2(void) { return SDL_HasSSE2() == SDL_TRUE; }
+static bool HasAVX2(void) { return SDL_HasAVX2() == SDL_TRUE; }
+#endif
+
+static const struct
+{
+	const char* name;
+	SpanKernel kernel;
+	bool (*supported)(void);
+} kernels[] =
+{
+#ifdef SPAN_X86
+	{ "avx2", KernelAVX2, HasAVX2 },
+	{ "sse2", KernelSSE2, HasSSE2 },
+#endif
+	{ "scalar", KernelScalar, NULL }
+};
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static int kernelIdx = -1;
+
+static SpanKernel GetKernel(void)
+{
+	if (kernelIdx < 0)
+	{
+		// Kernels are listed fastest first
+		for (kernelIdx = 0; kernelIdx < NUM_KERNELS - 1; ++kernelIdx)
+			if (kernels[kernelIdx].supported())
+				break;
+	}
+	return kernels[kernelIdx].kernel;
+}
+
+const char* GetSpanKernel(void)
+{
+	GetKernel();
+	return kernels[kernelIdx].name;
+}
+
+bool SetSpanKernel(const char* name)
+{
+	for (int i = 0; i < NUM_KERNELS; ++i)
+	{
+		if (strcmp(kernels[i].name, name))
+			continue;
+		if (kernels[i].supported && !kernels[i].supported())
+			return false;
+		kernelIdx = i;
+		return true;
+	}
+	return false;
+}
+
+void SpanBlend(uint32_t* dst, const uint8_t* coverage, int count, uint32_t colour)
+{
+	GetKernel()(dst, coverage, count, colour);
+}
@@ -0,0 +1,41 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Pixels are stored as R, G, B, A bytes in memory order, colours passed
+// to span functions use the same order & are premultiplied by alpha.
+
+// Pack an 0xRRGGBBAA colour into a pixel.
+//
+// Params:
+//   c       - Colour as passed to SetDrawColour.
+//   premult - Multiply the colour channels by alpha for blending.
+uint32_t SpanPackColour(uint32_t c, bool premult);
+
+// Overwrite a run of pixels with a colour.
+void SpanFill(uint32_t* dst, int count, uint32_t colour);
+
+// Blend a premultiplied colour over a run of pixels.
+//
+// Params:
+//   dst      - First pixel of the run.
+//   coverage - Coverage of each pixel from 0 to 255, scales the colour.
+//   count    - Number of pixels.
+//   colour   - Premultiplied colour from SpanPackColour.
+void SpanBlend(uint32_t* dst, const uint8_t* coverage, int count, uint32_t colour);
+
+// Get the name of the span kernel in use, picked by CPU features.
+//
+// Call once before blending from several threads, as the first call
+// makes the pick.
+const char* GetSpanKernel(void);
+
+// Force a span kernel by name ("avx2", "sse2" or "scalar").
+//
+// Returns:
+//   true on success, false if unknown or unsupported by the CPU.
+bool SetSpanKernel(const char* name);
+
+#endif//SPAN_H
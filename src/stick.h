@@ -3,23 +3,34 @@
 
 #include "maths.h"
 #include "util.h"
+#include "curve.h"
 #include <stdbool.h>
+#include <stddef.h>
+
+// Outer edge of the analogue deadzone, magnitudes past this saturate.
+#define ANALOGUE_OUTER_DEADZONE 0.99
 
 typedef struct
 {
 	// common
 	vector rawpos, compos;
 	bool recalc;
+	uint64_t inputTime; // Performance counter time of the oldest unpresented input, 0 if none
 
 	// analogue
 	double preaccel, postacel;
-	double accelpow;
+	ResponseCurve curve;
 	double deadzone;
 
 	// digital
 	point digixy;
 	double digiangle;
 	double digideadzone;
+
+	// retained static elements
+	int layer;     // Draw layer index, or -1 to draw everything directly
+	bool restatic; // Set when a parameter affecting static elements changes
+	rect layerwin; // Window rect the layer was captured for
 } StickState;
 
 inline void InitDefaults(StickState* p)
@@ -28,16 +39,73 @@ inline void InitDefaults(StickState* p)
 	p->compos = (vector){0.0, 0.0};
 
 	p->recalc = true;
+	p->inputTime = 0;
 	p->preaccel = 0.0;
 	p->postacel = 0.0;
-	p->accelpow = 1.25;
+	InitCurve(&p->curve, CURVE_RATIONAL, DefaultCurveParam(CURVE_RATIONAL));
 	p->deadzone = 0.125;
 
 	p->digixy = (point){0, 0};
 	p->digiangle = sqrt(2.0) - 1.0;
 	p->digideadzone = 0.5;
+
+	p->layer = -1;
+	p->restatic = true;
+	p->layerwin = (rect){0, 0, 0, 0};
 }
 
+vector RadialDeadzone(vector v, double min, double max);
+vector ApplyAcceleration(vector v, ResponseCurve* curve);
+point DigitalEight(vector v, double angle, double deadzone);
+vector DigitalToVector(point p);
+
+// Batch versions of the analogue pipeline, processing structure-of-arrays
+// samples in place. The fastest kernel supported by the CPU is picked on
+// first use. Every kernel matches the single sample functions within
+// BATCH_TOLERANCE per component (see padlab_check_batch, run by ctest),
+// the fused form rounding differently.
+#define BATCH_TOLERANCE 1e-12
+
+void RadialDeadzoneBatch(double* x, double* y, size_t n, double min, double max);
+void ApplyAccelerationBatch(double* x, double* y, size_t n, ResponseCurve* curve);
+
+// Deadzone & accelerate a batch in a single pass, equivalent to the
+// processing DrawAnalogue applies to a single sample.
+void AnalogueBatch(double* x, double* y, size_t n, StickState* p);
+
+// Get the name of the kernel used by the batch functions.
+const char* GetStickBatchKernel(void);
+
+// Force a batch kernel by name ("avx2", "sse2" or "scalar").
+//
+// Returns:
+//   true on success, false if unknown or unsupported by the CPU.
+bool SetStickBatchKernel(const char* name);
+
+// Integer-only versions of the pipeline operating on Q16.16 values
+// converted from raw axis values with FxFromAxis.
+//
+// Compared with the double precision functions over the full int16 range
+// (see padlab_check_fixed, run by ctest):
+//   - RadialDeadzoneFx output is within FIXED_DEADZONE_TOLERANCE per component.
+//   - ApplyAccelerationFx output is within FIXED_TOLERANCE per component
+//     for curves with a slope of at most 4, the deadzone error being
+//     magnified by the curve's slope.
+//   - DigitalEightFx output is identical except for inputs within
+//     FIXED_TOLERANCE of a zone boundary.
+#define FIXED_DEADZONE_TOLERANCE (4.0 / (double)FX_ONE) // 4 ulp, 2^-14
+#define FIXED_TOLERANCE          (16.0 / (double)FX_ONE) // 16 ulp, 2^-12
+
+fxvector RadialDeadzoneFx(fxvector v, fixed_t min, fixed_t max);
+fxvector ApplyAccelerationFx(fxvector v, const fixed_t* table);
+point DigitalEightFx(fxvector v, fixed_t angle, fixed_t deadzone);
+
+// Run the analogue or digital pipeline on rawpos if recalc is set,
+// updating compos & the intermediate values drawn by the panels.
+void UpdateAnalogue(StickState* p);
+void UpdateDigital(StickState* p);
+
+// Update & draw a stick panel, implemented in stick_draw.c.
 void DrawAnalogue(const rect* win, StickState* p);
 void DrawDigital(const rect* win, StickState* p);
 
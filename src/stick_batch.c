@@ -0,0 +1,218 @@
+#include "stick.h"
+#include <SDL_cpuinfo.h>
+#include <string.h>
+
+#if defined __x86_64__ || defined _M_X64 || defined __i386__ || defined _M_IX86
+ #define BATCH_X86
+ #include <immintrin.h>
+ #if defined __GNUC__ || defined __clang__
+  #define TARGET_SSE2 __attribute__((target("sse2")))
+  #define TARGET_AVX2 __attribute__((target("avx2")))
+ #else
+  #define TARGET_SSE2
+  #define TARGET_AVX2
+ #endif
+#endif
+
+enum
+{
+	STAGE_DEADZONE = 1 << 0,
+	STAGE_ACCEL    = 1 << 1
+};
+
+typedef struct
+{
+	int stages;
+	double min, invRange; // Deadzone inner edge & reciprocal of its width
+	const double* table;  // Baked response curve
+} BatchParams;
+
+typedef void (*BatchKernel)(double* x, double* y, size_t n, const BatchParams* p);
+
+
+// All kernels evaluate the same fused form of the pipeline:
+//   mag   = |v|
+//   r     = deadzone ? min((mag - min) / (max - min), 1) : mag
+//   r     = accel ? lerp(table, r) : r
+//   v'    = mag > min ? v * r / mag : 0
+// so each sample costs one sqrt, one divide & two table loads.
+static void KernelScalar(double* x, double* y, size_t n, const BatchParams* p)
+{
+	const double min = (p->stages & STAGE_DEADZONE) ? p->min : 0.0;
+	for (size_t i = 0; i < n; ++i)
+	{
+		const double mag = sqrt(x[i] * x[i] + y[i] * y[i]);
+		if (mag <= min)
+		{
+			x[i] = y[i] = 0.0;
+			continue;
+		}
+
+		double r = mag;
+		if (p->stages & STAGE_DEADZONE)
+			r = MIN((mag - min) * p->invRange, 1.0);
+		if (p->stages & STAGE_ACCEL)
+			r = SampleCurveTable(p->table, r);
+
+		const double scale = r / mag;
+		x[i] *= scale;
+		y[i] *= scale;
+	}
+}
+
+#ifdef BATCH_X86
+TARGET_SSE2 static void KernelSSE2(double* x, double* y, size_t n, const BatchParams* p)
+{
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d min = _mm_set1_pd((p->stages & STAGE_DEADZONE) ? p->min : 0.0);
+	const __m128d invRange = _mm_set1_pd(p->invRange);
+	const __m128d tableSize = _mm_set1_pd((double)CURVE_TABLE_SIZE);
+	const __m128d lastIdx = _mm_set1_pd((double)(CURVE_TABLE_SIZE - 1));
+
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2)
+	{
+		const __m128d vx = _mm_loadu_pd(&x[i]);
+		const __m128d vy = _mm_loadu_pd(&y[i]);
+		const __m128d mag = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(vx, vx), _mm_mul_pd(vy, vy)));
+		const __m128d live = _mm_cmpgt_pd(mag, min);
+
+		__m128d r = mag;
+		if (p->stages & STAGE_DEADZONE)
+			r = _mm_min_pd(_mm_mul_pd(_mm_sub_pd(mag, min), invRange), one);
+		if (p->stages & STAGE_ACCEL)
+		{
+			// No gathers in SSE2, load each lane's neighbouring entries as a pair
+			const __m128d fx = _mm_mul_pd(_mm_min_pd(_mm_max_pd(r, zero), one), tableSize);
+			const __m128i idx = _mm_cvttpd_epi32(_mm_min_pd(fx, lastIdx));
+			const __m128d a = _mm_loadu_pd(&p->table[_mm_cvtsi128_si32(idx)]);
+			const __m128d b = _mm_loadu_pd(&p->table[_mm_cvtsi128_si32(_mm_shuffle_epi32(idx, 1))]);
+			const __m128d lo = _mm_unpacklo_pd(a, b), hi = _mm_unpackhi_pd(a, b);
+			const __m128d frac = _mm_sub_pd(fx, _mm_cvtepi32_pd(idx));
+			r = _mm_add_pd(lo, _mm_mul_pd(_mm_sub_pd(hi, lo), frac));
+		}
+
+		// Masking also discards the NaN from 0 / 0
+		const __m128d scale = _mm_and_pd(live, _mm_div_pd(r, mag));
+		_mm_storeu_pd(&x[i], _mm_mul_pd(vx, scale));
+		_mm_storeu_pd(&y[i], _mm_mul_pd(vy, scale));
+	}
+	KernelScalar(&x[i], &y[i], n - i, p);
+}
+
+TARGET_AVX2 static void KernelAVX2(double* x, double* y, size_t n, const BatchParams* p)
+{
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d min = _mm256_set1_pd((p->stages & STAGE_DEADZONE) ? p->min : 0.0);
+	const __m256d invRange = _mm256_set1_pd(p->invRange);
+	const __m256d tableSize = _mm256_set1_pd((double)CURVE_TABLE_SIZE);
+	const __m256d lastIdx = _mm256_set1_pd((double)(CURVE_TABLE_SIZE - 1));
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256d vx = _mm256_loadu_pd(&x[i]);
+		const __m256d vy = _mm256_loadu_pd(&y[i]);
+		const __m256d mag = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(vx, vx), _mm256_mul_pd(vy, vy)));
+		const __m256d live = _mm256_cmp_pd(mag, min, _CMP_GT_OQ);
+
+		__m256d r = mag;
+		if (p->stages & STAGE_DEADZONE)
+			r = _mm256_min_pd(_mm256_mul_pd(_mm256_sub_pd(mag, min), invRange), one);
+		if (p->stages & STAGE_ACCEL)
+		{
+			const __m256d fx = _mm256_mul_pd(_mm256_min_pd(_mm256_max_pd(r, zero), one), tableSize);
+			const __m128i idx = _mm256_cvttpd_epi32(_mm256_min_pd(fx, lastIdx));
+			const __m256d lo = _mm256_i32gather_pd(p->table, idx, sizeof(double));
+			const __m256d hi = _mm256_i32gather_pd(p->table + 1, idx, sizeof(double));
+			const __m256d frac = _mm256_sub_pd(fx, _mm256_cvtepi32_pd(idx));
+			r = _mm256_add_pd(lo, _mm256_mul_pd(_mm256_sub_pd(hi, lo), frac));
+		}
+
+		const __m256d scale = _mm256_and_pd(live, _mm256_div_pd(r, mag));
+		_mm256_storeu_pd(&x[i], _mm256_mul_pd(vx, scale));
+		_mm256_storeu_pd(&y[i], _mm256_mul_pd(vy, scale));
+	}
+	KernelSSE2(&x[i], &y[i], n - i, p);
+}
+
+static bool HasSSE2(void) { return SDL_HasSSE2() == SDL_TRUE; }
+static bool HasAVX2(void) { return SDL_HasAVX2() == SDL_TRUE; }
+#endif
+
+static const struct
+{
+	const char* name;
+	BatchKernel kernel;
+	bool (*supported)(void);
+} kernels[] =
+{
+#ifdef BATCH_X86
+	{ "avx2", KernelAVX2, HasAVX2 },
+	{ "sse2", KernelSSE2, HasSSE2 },
+#endif
+	{ "scalar", KernelScalar, NULL }
+};
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static int kernelIdx = -1;
+
+static BatchKernel GetKernel(void)
+{
+	if (kernelIdx < 0)
+	{
+		// Kernels are listed fastest first
+		for (kernelIdx = 0; kernelIdx < NUM_KERNELS - 1; ++kernelIdx)
+			if (kernels[kernelIdx].supported())
+				break;
+	}
+	return kernels[kernelIdx].kernel;
+}
+
+const char* GetStickBatchKernel(void)
+{
+	GetKernel();
+	return kernels[kernelIdx].name;
+}
+
+bool SetStickBatchKernel(const char* name)
+{
+	for (int i = 0; i < NUM_KERNELS; ++i)
+	{
+		if (strcmp(kernels[i].name, name))
+			continue;
+		if (kernels[i].supported && !kernels[i].supported())
+			return false;
+		kernelIdx = i;
+		return true;
+	}
+	return false;
+}
+
+
+void RadialDeadzoneBatch(double* x, double* y, size_t n, double min, double max)
+{
+	const BatchParams p = {
+		.stages = STAGE_DEADZONE,
+		.min = min, .invRange = 1.0 / (max - min) };
+	GetKernel()(x, y, n, &p);
+}
+
+void ApplyAccelerationBatch(double* x, double* y, size_t n, ResponseCurve* curve)
+{
+	const BatchParams p = {
+		.stages = STAGE_ACCEL,
+		.table = GetCurveTable(curve) };
+	GetKernel()(x, y, n, &p);
+}
+
+void AnalogueBatch(double* x, double* y, size_t n, StickState* s)
+{
+	const BatchParams p = {
+		.stages = STAGE_DEADZONE | STAGE_ACCEL,
+		.min = s->deadzone, .invRange = 1.0 / (ANALOGUE_OUTER_DEADZONE - s->deadzone),
+		.table = GetCurveTable(&s->curve) };
+	GetKernel()(x, y, n, &p);
+}
@@ -0,0 +1,252 @@
+#include "stick.h"
+#include "draw.h"
+#include "counters.h"
+#include <string.h>
+
+// Start drawing the static elements of a stick panel.
+//
+// Returns:
+//   true if the static elements need to be drawn, false if the
+//   retained layer was still up to date & has been drawn instead.
+static bool BeginStatic(const rect* win, StickState* p)
+{
+	if (p->layer < 0)
+		return true;
+
+	if (!p->restatic && IsDrawLayerValid(p->layer) &&
+		!memcmp(win, &p->layerwin, sizeof(rect)))
+	{
+		DrawLayer(p->layer);
+		return false;
+	}
+
+	BeginDrawLayer(p->layer, *win);
+	return true;
+}
+
+static void EndStatic(const rect* win, StickState* p)
+{
+	if (p->layer < 0)
+		return;
+
+	EndDrawLayer();
+	DrawLayer(p->layer);
+	p->layerwin = *win;
+	p->restatic = false;
+}
+
+static void DrawRangeRect(const rect* win, int rectSz)
+{
+	SetDrawColour(GREY3);
+	DrawRect(
+		win->x + (win->w - rectSz) / 2,
+		win->y + (win->h - rectSz) / 2,
+		rectSz, rectSz);
+}
+
+static void DrawAxisLines(const rect* win, int ox, int oy)
+{
+	SetDrawColour(GREY2);
+	DrawLine(
+		win->x, oy,
+		win->x + win->w, oy);
+	DrawLine(
+		ox, win->y,
+		ox, win->y + win->h);
+}
+
+static void DrawPositions(int ox, int oy, double size, const StickState* p, uint32_t colour)
+{
+	// compensated position
+	SetDrawColour(colour);
+	DrawCircle(
+		ox + (int)round(p->compos.x * size / 2.0),
+		oy + (int)round(p->compos.y * size / 2.0),
+		8);
+	DrawPoint(
+		ox + (int)round(p->compos.x * size / 2.0),
+		oy + (int)round(p->compos.y * size / 2.0));
+
+	// raw position
+	SetDrawColour(WHITE);
+	DrawLine(
+		ox + (int)round(p->rawpos.x * size / 2.0) - 4,
+		oy + (int)round(p->rawpos.y * size / 2.0),
+		ox + (int)round(p->rawpos.x * size / 2.0) + 4,
+		oy + (int)round(p->rawpos.y * size / 2.0));
+	DrawLine(
+		ox + (int)round(p->rawpos.x * size / 2.0),
+		oy + (int)round(p->rawpos.y * size / 2.0) - 4,
+		ox + (int)round(p->rawpos.x * size / 2.0),
+		oy + (int)round(p->rawpos.y * size / 2.0) + 4);
+}
+
+static void DrawAnalogueStatic(const rect* win, StickState* p, double size, int rectSz, int ox, int oy)
+{
+	DrawRangeRect(win, rectSz);
+
+	// acceleration curve
+	SetDrawColour(GREY5);
+	const int accelsamp = (int)(sqrt(size) * 4.20);
+	const double step = 1.0 / (double)accelsamp;
+	double y1 = SampleCurve(&p->curve, 0.0);
+	for (int i = 1; i <= accelsamp; ++i)
+	{
+		double y2 = SampleCurve(&p->curve, step * i);
+		DrawLine(
+			win->x + (int)(step * (i - 1) * size) + (win->w - rectSz) / 2,
+			win->y + (int)((1.0 - y1) * size) + (win->h - rectSz) / 2,
+			win->x + (int)(step * i * size) + (win->w - rectSz) / 2,
+			win->y + (int)((1.0 - y2) * size) + (win->h - rectSz) / 2);
+		y1 = y2;
+	}
+
+	// guide circle
+	SetDrawColour(GREY5);
+	DrawCircle(ox, oy, rectSz / 2);
+
+	SetDrawColour(GREY4);
+	DrawCircle(ox, oy, (int)round(p->deadzone * size) / 2);
+
+	// 0,0 line axis'
+	DrawAxisLines(win, ox, oy);
+}
+
+void DrawAnalogue(const rect* win, StickState* p)
+{
+	CounterAdd(COUNTER_RECALCS, p->recalc ? 1 : 0);
+	UpdateAnalogue(p);
+
+	const double size = (double)(win->w > win->h ? win->h : win->w) * DISPLAY_SCALE;
+	const int rectSz = (int)round(size);
+	const int ox = win->x + win->w / 2;
+	const int oy = win->y + win->h / 2;
+
+	if (BeginStatic(win, p))
+	{
+		DrawAnalogueStatic(win, p, size, rectSz, ox, oy);
+		EndStatic(win, p);
+	}
+
+	// acceleration tickers
+	const int tickerx = (int)((p->preaccel - 0.5) * size);
+	const int tickery = (int)((0.5 - p->postacel) * size);
+	SetDrawColour(HILIGHT_PU1);
+	DrawLine(
+		ox + tickerx,
+		win->y + (win->h - rectSz) / 2,
+		ox + tickerx,
+		win->y + (win->h + rectSz) / 2);
+	SetDrawColour(HILIGHT_PU2);
+	DrawLine(
+		win->x + (win->w - rectSz) / 2,
+		oy + tickery,
+		win->x + (win->w + rectSz) / 2,
+		oy + tickery);
+
+	DrawPositions(ox, oy, size, p, HILIGHT_PU3);
+}
+
+static void DrawDigitalStatic(const rect* win, int rectSz, int ox, int oy,
+	int outh, int outq, int innh, int innq)
+{
+	DrawRangeRect(win, rectSz);
+
+	// guide circle
+	SetDrawColour(GREY5);
+	DrawCircle(ox, oy, rectSz / 2);
+
+	// 0,0 line axis'
+	DrawAxisLines(win, ox, oy);
+
+	SetDrawColour(GREY4);
+
+	// angles preview
+	DrawLine(ox - outq, oy - outh, ox - innq, oy - innh);
+	DrawLine(ox + outq, oy - outh, ox + innq, oy - innh);
+	DrawLine(ox + outh, oy - outq, ox + innh, oy - innq);
+	DrawLine(ox + outh, oy + outq, ox + innh, oy + innq);
+	DrawLine(ox + outq, oy + outh, ox + innq, oy + innh);
+	DrawLine(ox - outq, oy + outh, ox - innq, oy + innh);
+	DrawLine(ox - outh, oy + outq, ox - innh, oy + innq);
+	DrawLine(ox - outh, oy - outq, ox - innh, oy - innq);
+
+	// deadzone octagon
+	DrawLine(ox - innq, oy - innh, ox + innq, oy - innh);
+	DrawLine(ox + innq, oy - innh, ox + innh, oy - innq);
+	DrawLine(ox + innh, oy - innq, ox + innh, oy - innq);
+	DrawLine(ox + innh, oy - innq, ox + innh, oy + innq);
+	DrawLine(ox + innh, oy + innq, ox + innq, oy + innh);
+	DrawLine(ox + innq, oy + innh, ox - innq, oy + innh);
+	DrawLine(ox - innq, oy + innh, ox - innh, oy + innq);
+	DrawLine(ox - innh, oy + innq, ox - innh, oy - innq);
+	DrawLine(ox - innh, oy - innq, ox - innq, oy - innh);
+}
+
+void DrawDigital(const rect* win, StickState* p)
+{
+	CounterAdd(COUNTER_RECALCS, p->recalc ? 1 : 0);
+	UpdateDigital(p);
+
+	const double size = (double)(win->w > win->h ? win->h : win->w) * DISPLAY_SCALE;
+	const int rectSz = (int)round(size);
+	const int radius = rectSz / 2;
+
+	// window centre
+	const int ox = win->x + win->w / 2;
+	const int oy = win->y + win->h / 2;
+
+	// calcuate points for the zone previews
+	const double outerinvmag = 1.0 / sqrt(1.0 + p->digiangle * p->digiangle);
+	const int outh = (int)round((size * outerinvmag) / 2.0);
+	const int outq = (int)round((size * outerinvmag) / 2.0 * p->digiangle);
+	const int innh = (int)round(p->digideadzone * size / 2.0);
+	const int innq = (int)round(p->digideadzone * size / 2.0 * p->digiangle);
+
+	if (BeginStatic(win, p))
+	{
+		DrawDigitalStatic(win, rectSz, ox, oy, outh, outq, innh, innq);
+		EndStatic(win, p);
+	}
+
+	// highlight active zone
+	if (p->digixy.x || p->digixy.y)
+	{
+		const int x = p->digixy.x;
+		const int y = p->digixy.y;
+
+		SetDrawColour(HILIGHT_GR2);
+
+		if (x)
+		{
+			if (y <= 0) DrawLine(ox + outh * x, oy - outq, ox + innh * x, oy - innq);
+			if (!y) DrawLine(ox + innh * x, oy + innq, ox + innh * x, oy - innq);
+			if (y >= 0) DrawLine(ox + outh * x, oy + outq, ox + innh * x, oy + innq);
+		}
+
+		if (y)
+		{
+			if (x <= 0) DrawLine(ox - outq, oy + outh * y, ox - innq, oy + innh * y);
+			if (!x) DrawLine(ox + innq, oy + innh * y, ox - innq, oy + innh * y);
+			if (x >= 0) DrawLine(ox + outq, oy + outh * y, ox + innq, oy + innh * y);
+		}
+
+		if (x && y)
+		{
+			DrawLine(ox + innh * x, oy + innq * y, ox + innq * x, oy + innh * y);
+			DrawArc(ox, oy, radius,
+				-(int)round(atan2(outerinvmag * p->digiangle * y, outerinvmag * x) * RAD2DEG),
+				-(int)round(atan2(outerinvmag * y, outerinvmag * p->digiangle * x) * RAD2DEG));
+		}
+		else
+		{
+			const int hemi = (int)round(atan2(outerinvmag * p->digiangle, outerinvmag) * RAD2DEG);
+			if (x > 0) DrawArc(ox, oy, radius, -hemi, hemi);
+			else if (y < 0) DrawArc(ox, oy, radius, -hemi + 90, hemi + 90);
+			else if (x < 0) DrawArc(ox, oy, radius, -hemi + 180, hemi + 180);
+			else if (y > 0) DrawArc(ox, oy, radius, -hemi + 270, hemi + 270);
+		}
+	}
+
+	DrawPositions(ox, oy, size, p, HILIGHT_GR3);
+}
@@ -0,0 +1,85 @@
+#include "stick.h"
+
+// Rounded integer square root of a 64-bit value
+static uint32_t ISqrt64(uint64_t n)
+{
+	uint64_t res = 0, bit = (uint64_t)1 << 62;
+	while (bit > n)
+		bit >>= 2;
+	while (bit)
+	{
+		if (n >= res + bit)
+		{
+			n -= res + bit;
+			res = (res >> 1) + bit;
+		}
+		else
+		{
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)(n > res ? res + 1 : res);
+}
+
+static inline fixed_t FxMagnitude(fxvector v)
+{
+	return (fixed_t)ISqrt64((uint64_t)((int64_t)v.x * v.x + (int64_t)v.y * v.y));
+}
+
+// Scale v to magnitude 'to' given its current magnitude 'mag'
+static inline fxvector FxRescale(fxvector v, fixed_t to, fixed_t mag)
+{
+	return (fxvector){
+		(fixed_t)((int64_t)v.x * to / mag),
+		(fixed_t)((int64_t)v.y * to / mag)};
+}
+
+
+fxvector RadialDeadzoneFx(fxvector v, fixed_t min, fixed_t max)
+{
+	const fixed_t mag = FxMagnitude(v);
+
+	if (mag <= min)
+		return (fxvector){0, 0};
+
+	if (mag >= max)
+		return FxRescale(v, FX_ONE, mag);
+
+	const fixed_t rescale = (fixed_t)(((int64_t)(mag - min) << FX_SHIFT) / (max - min));
+	return FxRescale(v, rescale, mag);
+}
+
+fxvector ApplyAccelerationFx(fxvector v, const fixed_t* table)
+{
+	const fixed_t mag = FxMagnitude(v);
+	if (mag <= 0)
+		return (fxvector){0, 0};
+
+	return FxRescale(v, SampleCurveTableFx(table, mag), mag);
+}
+
+point DigitalEightFx(fxvector v, fixed_t angle, fixed_t deadzone)
+{
+	const fixed_t absx = v.x < 0 ? -v.x : v.x;
+	const fixed_t absy = v.y < 0 ? -v.y : v.y;
+	point p = {0, 0};
+
+	if (FxMul(absx, angle) >= absy)
+	{
+		if (absx > deadzone)
+			p.x = v.x < 0 ? -1 : 1;
+	}
+	else if (FxMul(absy, angle) > absx)
+	{
+		if (absy > deadzone)
+			p.y = v.y < 0 ? -1 : 1;
+	}
+	else if (absx + absy >= FxMul(deadzone, FX_ONE + angle))
+	{
+		p.x = v.x < 0 ? -1 : 1;
+		p.y = v.y < 0 ? -1 : 1;
+	}
+
+	return p;
+}
@@ -0,0 +1,104 @@
+#include "tessellate.h"
+#include "maths.h"
+#include "util.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct
+{
+	int span, steps;
+	int cap;
+	tessvec* offsets;
+} UnitArc;
+
+static double maxError = TESS_MAX_ERROR;
+static int circleSteps[TESS_MAX_RADIUS + 1]; // 0 when not yet computed
+static UnitArc arcCache[TESS_CACHE_SIZE];
+static tessvec directions[360];
+static bool haveDirections = false;
+
+
+void SetTessellationDensity(double pixelsPerPoint)
+{
+	const double err = TESS_MAX_ERROR * (pixelsPerPoint > 0.0 ? pixelsPerPoint : 1.0);
+	if (err == maxError)
+		return;
+	maxError = err;
+	for (int i = 0; i <= TESS_MAX_RADIUS; ++i)
+		circleSteps[i] = 0;
+}
+
+static int CalcCircleSteps(int r)
+{
+	// A chord spanning theta deviates from the circle by r * (1 - cos(theta / 2))
+	if (maxError >= (double)r)
+		return 4;
+	const double theta = 2.0 * acos(1.0 - maxError / (double)r);
+	return CLAMP((int)ceil((double)TAU / theta), 4, TESS_MAX_STEPS);
+}
+
+int TessellationSteps(int r, int span)
+{
+	r = MAX(r, 1);
+	int steps;
+	if (r <= TESS_MAX_RADIUS)
+	{
+		if (!circleSteps[r])
+			circleSteps[r] = CalcCircleSteps(r);
+		steps = circleSteps[r];
+	}
+	else
+	{
+		steps = CalcCircleSteps(r);
+	}
+
+	span = abs(span);
+	if (span == 0)
+		return 0;
+	if (span >= 360)
+		return steps;
+	return MAX(1, (steps * span + 359) / 360);
+}
+
+const tessvec* GetUnitArc(int span, int steps)
+{
+	if (steps < 1)
+		return NULL;
+
+	UnitArc* a = &arcCache[((unsigned)span * 31u + (unsigned)steps) % TESS_CACHE_SIZE];
+	if (a->offsets && a->span == span && a->steps == steps)
+		return a->offsets;
+
+	if (steps + 1 > a->cap)
+	{
+		tessvec* tmp = realloc(a->offsets, (size_t)(steps + 1) * sizeof(tessvec));
+		if (!tmp)
+			return NULL;
+		a->offsets = tmp;
+		a->cap = steps + 1;
+	}
+	a->span  = span;
+	a->steps = steps;
+
+	const double stepSz = (double)span * DEG2RAD / (double)steps;
+	for (int i = 0; i <= steps; ++i)
+	{
+		const double theta = stepSz * (double)i;
+		a->offsets[i] = (tessvec){(float)cos(theta), (float)-sin(theta)};
+	}
+	// Close full circles exactly
+	if (span % 360 == 0)
+		a->offsets[steps] = a->offsets[0];
+	return a->offsets;
+}
+
+tessvec GetUnitDirection(int deg)
+{
+	if (!haveDirections)
+	{
+		for (int i = 0; i < 360; ++i)
+			directions[i] = (tessvec){(float)cos(i * DEG2RAD), (float)-sin(i * DEG2RAD)};
+		haveDirections = true;
+	}
+	return directions[(deg % 360 + 360) % 360];
+}
@@ -0,0 +1,59 @@
+#ifndef TESSELLATE_H
+#define TESSELLATE_H
+
+// Maximum distance in points between a circle & the chords approximating it.
+#define TESS_MAX_ERROR 0.125
+// Upper bound on the number of steps in a full circle.
+#define TESS_MAX_STEPS 1024
+// Circle step counts are memoised for radii up to this many pixels.
+#define TESS_MAX_RADIUS 1024
+// Number of unit arc tables kept around.
+#define TESS_CACHE_SIZE 64
+
+typedef struct { float x, y; } tessvec;
+
+// Set the pixel density of the drawable.
+//
+// The error bound is in points, so on HiDPI drawables it covers more
+// pixels & the same radius in pixels needs fewer steps.
+//
+// Params:
+//   pixelsPerPoint - Drawable size in pixels over window size in points.
+void SetTessellationDensity(double pixelsPerPoint);
+
+// Get the number of steps to draw an arc with.
+//
+// Params:
+//   r    - Radius in pixels.
+//   span - Arc span in degrees, 360 or more for a full circle.
+//
+// Returns:
+//   The fewest steps keeping the chord error within TESS_MAX_ERROR,
+//   at least 4 for a full circle & 0 for an empty span.
+int TessellationSteps(int r, int span);
+
+// Get precomputed unit offsets for an arc starting at 0 degrees.
+//
+// Offsets are in screen space (y down) going anti-clockwise, rotate them
+// w/ TessRotate to start elsewhere. Tables are cached by span & steps.
+//
+// Params:
+//   span  - Arc span in degrees, may be negative to go clockwise.
+//   steps - Number of steps, the table holds steps + 1 offsets.
+//
+// Returns:
+//   The offset table, valid until the next call, or NULL if out of memory.
+const tessvec* GetUnitArc(int span, int steps);
+
+// Get the screen space unit direction of an angle in whole degrees.
+tessvec GetUnitDirection(int deg);
+
+// Rotate a unit offset by a direction from GetUnitDirection.
+static inline tessvec TessRotate(tessvec v, tessvec dir)
+{
+	return (tessvec){
+		dir.x * v.x - dir.y * v.y,
+		dir.x * v.y + dir.y * v.x};
+}
+
+#endif//TESSELLATE_H
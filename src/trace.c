@@ -0,0 +1,306 @@
+#include "trace.h"
+#include <stdio.h>
+
+#ifdef USE_TRACE
+
+#include <SDL_thread.h>
+#include <SDL_mutex.h>
+#include <SDL_timer.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define CHUNK_EVENTS 4096 // Events in a thread buffer, 64 KiB each
+#define MAX_CHUNKS   256  // Buffers allocated at most, zones are dropped beyond
+#define MAX_LANES    64   // Named lanes, further threads get anonymous ones
+
+typedef struct
+{
+	uint64_t ticks;
+	const char* name; // NULL ends the innermost open zone
+} TraceEvent;
+
+typedef struct TraceChunk
+{
+	struct TraceChunk* next;
+	int lane, num;
+	TraceEvent events[CHUNK_EVENTS];
+} TraceChunk;
+
+typedef struct
+{
+	const char* name;
+	int index;
+} Lane;
+
+static bool tracing = false;
+static FILE* file = NULL;
+static bool firstEvent = true;
+static uint64_t startTicks = 0;
+static double usPerTick = 0.0;
+
+// Everything below is guarded by the mutex
+static SDL_TLSID tls = 0;
+static SDL_mutex* mutex = NULL;
+static SDL_cond* cond = NULL;
+static SDL_Thread* writer = NULL;
+static bool stopping = false;
+static TraceChunk* queue = NULL; // Full buffers waiting to be written, oldest first
+static TraceChunk** queueTail = &queue;
+static TraceChunk* spare = NULL;
+static int numChunks = 0;
+static Lane lanes[MAX_LANES];
+static int numLanes = 0, numAnonymous = 0;
+static unsigned long long dropped = 0;
+
+
+static TraceChunk* TakeChunk(void)
+{
+	TraceChunk* chunk = spare;
+	if (chunk)
+		spare = chunk->next;
+	else if (numChunks < MAX_CHUNKS && (chunk = malloc(sizeof(TraceChunk))) != NULL)
+		++numChunks;
+	if (chunk)
+	{
+		chunk->next = NULL;
+		chunk->num = 0;
+	}
+	return chunk;
+}
+
+static void QueueChunk(TraceChunk* chunk)
+{
+	if (!chunk->num)
+	{
+		chunk->next = spare;
+		spare = chunk;
+		return;
+	}
+	chunk->next = NULL;
+	*queueTail = chunk;
+	queueTail = &chunk->next;
+	SDL_CondSignal(cond);
+}
+
+// Hand a buffer over when its thread exits
+static void SDLCALL ReleaseChunk(void* data)
+{
+	if (!mutex)
+	{
+		free(data);
+		return;
+	}
+	SDL_LockMutex(mutex);
+	QueueChunk(data);
+	SDL_UnlockMutex(mutex);
+}
+
+// Queue a full buffer & take an empty one for the calling thread
+static TraceChunk* NextChunk(TraceChunk* chunk)
+{
+	SDL_LockMutex(mutex);
+	TraceChunk* next = TakeChunk();
+	if (next)
+	{
+		next->lane = chunk ? chunk->lane : MAX_LANES + ++numAnonymous;
+		if (chunk)
+			QueueChunk(chunk);
+		SDL_TLSSet(tls, next, ReleaseChunk);
+	}
+	else if (chunk)
+	{
+		// Writer is behind, start the buffer over rather than wait for it
+		dropped += (unsigned long long)chunk->num;
+		chunk->num = 0;
+		next = chunk;
+	}
+	else
+	{
+		++dropped;
+	}
+	SDL_UnlockMutex(mutex);
+	return next;
+}
+
+static inline void Push(const char* name)
+{
+	if (!tracing)
+		return;
+	TraceChunk* chunk = SDL_TLSGet(tls);
+	if ((!chunk || chunk->num == CHUNK_EVENTS) && (chunk = NextChunk(chunk)) == NULL)
+		return;
+	chunk->events[chunk->num++] = (TraceEvent){SDL_GetPerformanceCounter(), name};
+}
+
+void TraceBegin(const char* name)
+{
+	Push(name);
+}
+
+void TraceEnd(void)
+{
+	Push(NULL);
+}
+
+void TraceThread(const char* name, int index)
+{
+	if (!tracing)
+		return;
+
+	SDL_LockMutex(mutex);
+	int lane = 0;
+	while (lane < numLanes && (lanes[lane].index != index || strcmp(lanes[lane].name, name)))
+		++lane;
+	if (lane == numLanes && numLanes < MAX_LANES)
+		lanes[numLanes++] = (Lane){name, index};
+
+	TraceChunk* chunk = SDL_TLSGet(tls);
+	if (!chunk && (chunk = TakeChunk()) != NULL)
+		SDL_TLSSet(tls, chunk, ReleaseChunk);
+	if (chunk)
+		chunk->lane = lane < MAX_LANES ? lane + 1 : MAX_LANES + ++numAnonymous;
+	SDL_UnlockMutex(mutex);
+}
+
+static void WriteChunk(const TraceChunk* chunk)
+{
+	for (int i = 0; i < chunk->num; ++i)
+	{
+		const TraceEvent* e = &chunk->events[i];
+		const double ts = (double)(e->ticks - startTicks) * usPerTick;
+		fputs(firstEvent ? "\n" : ",\n", file);
+		firstEvent = false;
+		if (e->name)
+			fprintf(file, "{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+				e->name, ts, chunk->lane);
+		else
+			fprintf(file, "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}", ts, chunk->lane);
+	}
+}
+
+static int SDLCALL TraceWriter(void* data)
+{
+	SDL_LockMutex(mutex);
+	for (;;)
+	{
+		while (!queue && !stopping)
+			SDL_CondWait(cond, mutex);
+		TraceChunk* chunk = queue;
+		if (!chunk)
+			break;
+		if ((queue = chunk->next) == NULL)
+			queueTail = &queue;
+
+		SDL_UnlockMutex(mutex);
+		WriteChunk(chunk);
+		SDL_LockMutex(mutex);
+
+		chunk->next = spare;
+		spare = chunk;
+	}
+	SDL_UnlockMutex(mutex);
+	return 0;
+}
+
+static void FreeState(void)
+{
+	while (spare)
+	{
+		TraceChunk* next = spare->next;
+		free(spare);
+		spare = next;
+	}
+	if (cond)
+		SDL_DestroyCond(cond);
+	if (mutex)
+		SDL_DestroyMutex(mutex);
+	cond = NULL;
+	mutex = NULL;
+	writer = NULL;
+	stopping = false;
+	queue = NULL;
+	queueTail = &queue;
+	numChunks = numLanes = numAnonymous = 0;
+	dropped = 0;
+	firstEvent = true;
+}
+
+int TraceOpen(const char* path)
+{
+	if (tracing || (file = fopen(path, "w")) == NULL)
+		return -1;
+
+	if (!tls)
+		tls = SDL_TLSCreate();
+	mutex = SDL_CreateMutex();
+	cond = SDL_CreateCond();
+	startTicks = SDL_GetPerformanceCounter();
+	usPerTick = 1e6 / (double)SDL_GetPerformanceFrequency();
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+
+	if (!tls || !mutex || !cond || (writer = SDL_CreateThread(TraceWriter, "trace", NULL)) == NULL)
+	{
+		FreeState();
+		fclose(file);
+		file = NULL;
+		return -1;
+	}
+
+	tracing = true;
+	TraceThread("main", 0);
+	return 0;
+}
+
+void TraceClose(void)
+{
+	if (!tracing)
+		return;
+	tracing = false;
+
+	// Zones still open on this thread are written, ends are implied
+	TraceChunk* chunk = SDL_TLSGet(tls);
+	SDL_TLSSet(tls, NULL, NULL);
+	SDL_LockMutex(mutex);
+	if (chunk)
+		QueueChunk(chunk);
+	stopping = true;
+	SDL_CondSignal(cond);
+	SDL_UnlockMutex(mutex);
+	SDL_WaitThread(writer, NULL);
+
+	// Name the lanes
+	for (int i = 0; i < numLanes; ++i)
+	{
+		fputs(firstEvent ? "\n" : ",\n", file);
+		firstEvent = false;
+		if (lanes[i].index)
+			fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+				i + 1, lanes[i].name, lanes[i].index);
+		else
+			fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				i + 1, lanes[i].name);
+	}
+	fputs("\n]}\n", file);
+
+	const bool failed = ferror(file) != 0;
+	if (fclose(file) || failed)
+		fprintf(stderr, "failed to write trace\n");
+	if (dropped)
+		fprintf(stderr, "trace dropped %llu events while the writer was behind\n", dropped);
+	file = NULL;
+	FreeState();
+}
+
+#else
+
+int TraceOpen(const char* path)
+{
+	fprintf(stderr, "tracing isn't built in, configure with -DBUILD_TRACE=ON\n");
+	return -1;
+}
+
+void TraceClose(void) {}
+
+#endif//USE_TRACE
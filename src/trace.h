@@ -0,0 +1,47 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Scoped timeline zones written as Chrome trace-event JSON, viewable in
+// chrome://tracing or Perfetto. Zones only exist in builds with USE_TRACE
+// defined (BUILD_TRACE in CMake), the macros do nothing otherwise.
+//
+// Every thread records into its own buffer, which is handed to a writer
+// thread once full or when the thread exits.
+
+// Start writing a trace.
+//
+// Params:
+//   path - File to write, replaced if it exists.
+//
+// Returns:
+//   0 on success, -1 if the file couldn't be opened or tracing isn't built in.
+int TraceOpen(const char* path);
+
+// Finish writing the trace, once every other thread recording zones has exited.
+void TraceClose(void);
+
+#ifdef USE_TRACE
+
+// Open a zone on the calling thread, names must be string literals.
+void TraceBegin(const char* name);
+
+// Close the most recently opened zone on the calling thread.
+void TraceEnd(void);
+
+// Put the zones of the calling thread on a named lane, threads given the
+// same name & index share one. Call before recording any zones.
+void TraceThread(const char* name, int index);
+
+#define TRACE_BEGIN(NAME) TraceBegin(NAME)
+#define TRACE_END() TraceEnd()
+#define TRACE_THREAD(NAME, INDEX) TraceThread((NAME), (INDEX))
+
+#else
+
+#define TRACE_BEGIN(NAME) ((void)0)
+#define TRACE_END() ((void)0)
+#define TRACE_THREAD(NAME, INDEX) ((void)0)
+
+#endif//USE_TRACE
+
+#endif//TRACE_H
@@ -0,0 +1,514 @@
+#include "maths.h"
+#include "stick.h"
+#include "record.h"
+#include "pool.h"
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define TUNE_REST_RADIUS 0.2  // Raw magnitudes below this count as at rest
+#define TUNE_FULL_RAW    0.95 // Raw magnitude an excursion must reach to be timed
+#define TUNE_FULL_OUT    0.99 // Output magnitude that counts as fully deflected
+#define TUNE_DIAG_MAG    0.7  // Raw magnitude a diagonal must be held at
+#define TUNE_DIAG_ANGLE  15.0 // Degrees either side of 45 that count as diagonal
+#define TUNE_DIAG_EPS    1.0  // Output direction change in degrees that counts as a flip
+#define TUNE_BATCH       256  // Samples run through the analogue pipeline at once
+
+typedef struct { uint64_t time; vector pos; } Sample;
+
+// Positions of one stick of one device in a trace, in time order
+typedef struct
+{
+	int trace;
+	int32_t device;
+	int stick;
+	vector pos;
+	Sample* samples;
+	int count, cap;
+} Stream;
+
+typedef struct { double min, max; int steps; } Range;
+
+typedef enum
+{
+	PIPE_ANALOGUE, // Radial deadzone & response curve
+	PIPE_DIGITAL,  // 8-way digital zones
+	NUM_PIPES
+} Pipeline;
+
+typedef struct
+{
+	Pipeline pipe;
+	double params[2];  // deadzone & curve parameter, or digiangle & digideadzone
+	double jitter;     // Mean output movement per sample at rest
+	double fullTime;   // Mean milliseconds from leaving rest to full output
+	double diagFlips;  // Fraction of held diagonal samples where the output turned
+	double score;      // Weighted sum of the normalised metrics, lower is better
+} Result;
+
+typedef struct
+{
+	Pipeline pipe;
+	CurveType curve;
+	Range ranges[2];
+	const Stream* streams;
+	int numStreams;
+	Result* results;
+} Sweep;
+
+static const char* const pipeNames[NUM_PIPES] = { "analogue", "digital" };
+static const char* const paramNames[NUM_PIPES][2] =
+{
+	{ "deadzone", "accel" },
+	{ "digiangle", "digideadzone" }
+};
+
+// Curve parameter sweeps, covering what SetCurveTuning can reach
+static const Range accelRanges[NUM_CURVE_TYPES] =
+{
+	[CURVE_RATIONAL]  = { 0.5, 3.0, 6 },
+	[CURVE_POWER]     = { 1.0, 4.0, 7 },
+	[CURVE_PIECEWISE] = { 0.0, 0.9, 7 },
+	[CURVE_BEZIER]    = { 0.0, 1.0, 6 }
+};
+
+
+static double RangeValue(Range r, int i)
+{
+	return r.steps > 1 ? r.min + (r.max - r.min) * (double)i / (double)(r.steps - 1) : r.min;
+}
+
+static bool ParseRange(const char* str, Range* out)
+{
+	Range r;
+	if (sscanf(str, "%lf:%lf:%d", &r.min, &r.max, &r.steps) != 3 || r.steps < 1)
+		return false;
+	*out = r;
+	return true;
+}
+
+static bool PushSample(Stream* s, uint64_t time)
+{
+	if (s->count == s->cap)
+	{
+		const int newCap = MAX(s->cap * 2, 1024);
+		Sample* tmp = realloc(s->samples, (size_t)newCap * sizeof(Sample));
+		if (!tmp)
+			return false;
+		s->samples = tmp;
+		s->cap = newCap;
+	}
+	s->samples[s->count++] = (Sample){time, s->pos};
+	return true;
+}
+
+// Append the stick positions in a trace to the stream list.
+//
+// Returns:
+//   0 on success, -1 on failure.
+static int LoadTrace(const char* path, int trace, Stream** streams, int* numStreams)
+{
+	FILE* file = OpenTrace(path);
+	if (!file)
+	{
+		fprintf(stderr, "failed to open \"%s\"\n", path);
+		return -1;
+	}
+
+	InputRecord record;
+	while (ReadRecord(file, &record))
+	{
+		if (record.axis > SDL_CONTROLLER_AXIS_RIGHTY)
+			continue;
+		const int stick = record.axis / 2;
+
+		Stream* s = NULL;
+		for (int i = 0; i < *numStreams && !s; ++i)
+		{
+			Stream* it = &(*streams)[i];
+			if (it->trace == trace && it->device == record.device && it->stick == stick)
+				s = it;
+		}
+		if (!s)
+		{
+			Stream* tmp = realloc(*streams, (size_t)(*numStreams + 1) * sizeof(Stream));
+			if (!tmp)
+				goto error;
+			*streams = tmp;
+			s = &tmp[(*numStreams)++];
+			*s = (Stream){trace, record.device, stick, {0.0, 0.0}, NULL, 0, 0};
+		}
+
+		const vec_t value = (vec_t)record.value / (vec_t)0x7FFF;
+		if (record.axis % 2)
+			s->pos.y = value;
+		else
+			s->pos.x = value;
+		if (!PushSample(s, record.time))
+			goto error;
+	}
+	fclose(file);
+	return 0;
+
+error:
+	fprintf(stderr, "out of memory loading \"%s\"\n", path);
+	fclose(file);
+	return -1;
+}
+
+
+typedef struct
+{
+	double restMotion;
+	unsigned restSamples;
+	double fullTime; // Nanoseconds
+	unsigned excursions;
+	unsigned diagFlips, diagPairs;
+} Metrics;
+
+static inline double Magnitude(vector v)
+{
+	return sqrt(v.x * v.x + v.y * v.y);
+}
+
+static bool NearDiagonal(vector v)
+{
+	const double deg = fmod(fabs(atan2(v.y, v.x)) * RAD2DEG, 90.0);
+	return fabs(deg - 45.0) <= TUNE_DIAG_ANGLE;
+}
+
+static void EvalStream(const Stream* s, StickState* st, Pipeline pipe, Metrics* m)
+{
+	st->rawpos = (vector){0.0, 0.0};
+	st->compos = (vector){0.0, 0.0};
+
+	vector last = {0.0, 0.0};
+	bool excursion = false, rawFull = false, outFull = false, prevDiag = false;
+	uint64_t start = 0, fullAt = 0;
+	double batchX[TUNE_BATCH], batchY[TUNE_BATCH];
+	for (int i = 0; i < s->count; ++i)
+	{
+		const Sample* sample = &s->samples[i];
+		vector out;
+		if (pipe == PIPE_ANALOGUE)
+		{
+			// The analogue pipeline keeps no state between samples, so it runs ahead in batches
+			const int j = i % TUNE_BATCH;
+			if (!j)
+			{
+				const int n = MIN(s->count - i, TUNE_BATCH);
+				for (int k = 0; k < n; ++k)
+				{
+					batchX[k] = s->samples[i + k].pos.x;
+					batchY[k] = s->samples[i + k].pos.y;
+				}
+				AnalogueBatch(batchX, batchY, (size_t)n, st);
+			}
+			out = (vector){batchX[j], batchY[j]};
+		}
+		else
+		{
+			st->rawpos = sample->pos;
+			st->recalc = true;
+			UpdateDigital(st);
+			out = st->compos;
+		}
+
+		const double rawMag = Magnitude(sample->pos);
+		const double outMag = Magnitude(out);
+		const double moved = Magnitude((vector){out.x - last.x, out.y - last.y});
+
+		// Any output movement while the stick is left alone is jitter
+		if (rawMag < TUNE_REST_RADIUS)
+		{
+			m->restMotion += moved;
+			++m->restSamples;
+		}
+
+		// Time each excursion that reaches the rim from leaving rest to full output
+		if (!excursion && rawMag >= TUNE_REST_RADIUS)
+		{
+			excursion = true;
+			rawFull = outFull = false;
+			start = sample->time;
+		}
+		if (excursion)
+		{
+			rawFull |= rawMag >= TUNE_FULL_RAW;
+			if (!outFull && outMag >= TUNE_FULL_OUT)
+			{
+				outFull = true;
+				fullAt = sample->time;
+			}
+			if (rawMag < TUNE_REST_RADIUS || i == s->count - 1)
+			{
+				// Excursions that never got to full output count their whole length
+				if (rawFull)
+				{
+					m->fullTime += (double)((outFull ? fullAt : sample->time) - start);
+					++m->excursions;
+				}
+				excursion = false;
+			}
+		}
+
+		// Count turns of the output while a diagonal is held
+		const bool diag = rawMag >= TUNE_DIAG_MAG && NearDiagonal(sample->pos);
+		if (diag && prevDiag)
+		{
+			const double turn = fabs(atan2(out.x * last.y - out.y * last.x, out.x * last.x + out.y * last.y));
+			if (outMag == 0.0 || Magnitude(last) == 0.0 || turn * RAD2DEG > TUNE_DIAG_EPS)
+				++m->diagFlips;
+			++m->diagPairs;
+		}
+		prevDiag = diag;
+		last = out;
+	}
+}
+
+static void EvalJob(void* ctx, int index)
+{
+	const Sweep* sweep = ctx;
+	Result* r = &sweep->results[index];
+	r->pipe = sweep->pipe;
+	r->params[0] = RangeValue(sweep->ranges[0], index / sweep->ranges[1].steps);
+	r->params[1] = RangeValue(sweep->ranges[1], index % sweep->ranges[1].steps);
+
+	StickState st;
+	InitDefaults(&st);
+	if (sweep->pipe == PIPE_ANALOGUE)
+	{
+		st.deadzone = r->params[0];
+		InitCurve(&st.curve, sweep->curve, r->params[1]);
+	}
+	else
+	{
+		st.digiangle = r->params[0];
+		st.digideadzone = r->params[1];
+	}
+
+	Metrics m = {0};
+	for (int i = 0; i < sweep->numStreams; ++i)
+		EvalStream(&sweep->streams[i], &st, sweep->pipe, &m);
+
+	r->jitter = m.restSamples ? m.restMotion / (double)m.restSamples : 0.0;
+	r->fullTime = m.excursions ? m.fullTime / (double)m.excursions / 1e6 : 0.0;
+	r->diagFlips = m.diagPairs ? (double)m.diagFlips / (double)m.diagPairs : 0.0;
+}
+
+// Score results by their metrics normalised to the range seen in the sweep.
+static void ScoreResults(Result* results, int count, const double weights[3])
+{
+	double lo[3], hi[3];
+	for (int j = 0; j < 3; ++j)
+	{
+		lo[j] = INFINITY;
+		hi[j] = -INFINITY;
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		const double v[3] = {results[i].jitter, results[i].fullTime, results[i].diagFlips};
+		for (int j = 0; j < 3; ++j)
+		{
+			lo[j] = MIN(lo[j], v[j]);
+			hi[j] = MAX(hi[j], v[j]);
+		}
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		const double v[3] = {results[i].jitter, results[i].fullTime, results[i].diagFlips};
+		results[i].score = 0.0;
+		for (int j = 0; j < 3; ++j)
+			if (hi[j] > lo[j])
+				results[i].score += weights[j] * (v[j] - lo[j]) / (hi[j] - lo[j]);
+	}
+}
+
+static int CompareResults(const void* a, const void* b)
+{
+	const Result* l = a;
+	const Result* r = b;
+	if (l->score != r->score)
+		return l->score < r->score ? -1 : 1;
+	if (l->params[0] != r->params[0])
+		return l->params[0] < r->params[0] ? -1 : 1;
+	if (l->params[1] != r->params[1])
+		return l->params[1] < r->params[1] ? -1 : 1;
+	return 0;
+}
+
+static void PrintTable(const Result* results, int count, int top)
+{
+	const Pipeline pipe = results[0].pipe;
+	printf("%4s  %12s  %12s  %10s  %9s  %9s  %6s\n", "rank",
+		paramNames[pipe][0], paramNames[pipe][1],
+		"jitter", "full ms", "diag flip", "score");
+	for (int i = 0; i < count && (top <= 0 || i < top); ++i)
+	{
+		const Result* r = &results[i];
+		printf("%4d  %12.4f  %12.4f  %10.6f  %9.2f  %9.4f  %6.3f\n", i + 1,
+			r->params[0], r->params[1], r->jitter, r->fullTime, r->diagFlips, r->score);
+	}
+}
+
+static void WriteCSVRows(FILE* file, const Result* results, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		const Result* r = &results[i];
+		fprintf(file, "%s,%d,%s,%g,%s,%g,%g,%g,%g,%g\n",
+			pipeNames[r->pipe], i + 1,
+			paramNames[r->pipe][0], r->params[0],
+			paramNames[r->pipe][1], r->params[1],
+			r->jitter, r->fullTime, r->diagFlips, r->score);
+	}
+}
+
+
+static void Usage(const char* argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options] TRACE...\n"
+		"  --curve NAME              response curve type (default rational)\n"
+		"  --deadzone MIN:MAX:N      analogue deadzone sweep (default 0:0.3:7)\n"
+		"  --accel MIN:MAX:N         response curve parameter sweep (default per curve)\n"
+		"  --digiangle MIN:MAX:N     digital diagonal angle sweep (default 0.2:0.6:5)\n"
+		"  --digideadzone MIN:MAX:N  digital deadzone sweep (default 0.2:0.6:5)\n"
+		"  --weights J,T,D           score weights of jitter at rest, time to full\n"
+		"                            deflection & diagonal flips (default 1,1,1)\n"
+		"  --threads N               worker threads (default one per core)\n"
+		"  --top N                   rows to print per table, 0 for all (default 20)\n"
+		"  --csv FILE                also write every result to FILE\n",
+		argv0);
+}
+
+int main(int argc, char** argv)
+{
+	CurveType curve = CURVE_RATIONAL;
+	Range ranges[NUM_PIPES][2] =
+	{
+		{ { 0.0, 0.3, 7 }, { 0.0, 0.0, 0 } },
+		{ { 0.2, 0.6, 5 }, { 0.2, 0.6, 5 } }
+	};
+	bool haveAccel = false;
+	double weights[3] = {1.0, 1.0, 1.0};
+	int threads = PoolDefaultThreads();
+	int top = 20;
+	const char* csvPath = NULL;
+	const char** tracePaths = calloc((size_t)argc, sizeof(const char*));
+	int numTraces = 0;
+	if (!tracePaths)
+		return 1;
+
+	bool ok = true;
+	for (int i = 1; i < argc && ok; ++i)
+	{
+		const bool hasArg = i + 1 < argc;
+		if (!strcmp(argv[i], "--curve") && hasArg)
+		{
+			const char* name = argv[++i];
+			ok = false;
+			for (int j = 0; j < NUM_CURVE_TYPES && !ok; ++j)
+			{
+				if ((ok = !strcmp(name, CurveName((CurveType)j))))
+					curve = (CurveType)j;
+			}
+		}
+		else if (!strcmp(argv[i], "--deadzone") && hasArg)
+			ok = ParseRange(argv[++i], &ranges[PIPE_ANALOGUE][0]);
+		else if (!strcmp(argv[i], "--accel") && hasArg)
+			ok = haveAccel = ParseRange(argv[++i], &ranges[PIPE_ANALOGUE][1]);
+		else if (!strcmp(argv[i], "--digiangle") && hasArg)
+			ok = ParseRange(argv[++i], &ranges[PIPE_DIGITAL][0]);
+		else if (!strcmp(argv[i], "--digideadzone") && hasArg)
+			ok = ParseRange(argv[++i], &ranges[PIPE_DIGITAL][1]);
+		else if (!strcmp(argv[i], "--weights") && hasArg)
+			ok = sscanf(argv[++i], "%lf,%lf,%lf", &weights[0], &weights[1], &weights[2]) == 3;
+		else if (!strcmp(argv[i], "--threads") && hasArg)
+			ok = (threads = atoi(argv[++i])) > 0;
+		else if (!strcmp(argv[i], "--top") && hasArg)
+			top = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--csv") && hasArg)
+			csvPath = argv[++i];
+		else if (argv[i][0] == '-')
+			ok = false;
+		else
+			tracePaths[numTraces++] = argv[i];
+	}
+	if (!ok || !numTraces)
+	{
+		Usage(argv[0]);
+		free(tracePaths);
+		return 1;
+	}
+	if (!haveAccel)
+		ranges[PIPE_ANALOGUE][1] = accelRanges[curve];
+
+	int res = 1;
+	Stream* streams = NULL;
+	int numStreams = 0;
+	Result* results[NUM_PIPES] = {NULL};
+	FILE* csv = NULL;
+	Pool* pool = NULL;
+
+	size_t numSamples = 0;
+	for (int i = 0; i < numTraces; ++i)
+		if (LoadTrace(tracePaths[i], i, &streams, &numStreams))
+			goto error;
+	for (int i = 0; i < numStreams; ++i)
+		numSamples += (size_t)streams[i].count;
+	if ((pool = PoolCreate(threads)) == NULL)
+		goto error;
+	// Also picks the batch kernel up front, rather than in every worker at once
+	printf("loaded %zu samples in %d streams from %d traces, using %d threads & %s kernels\n",
+		numSamples, numStreams, numTraces, PoolThreads(pool), GetStickBatchKernel());
+
+	if (csvPath)
+	{
+		if ((csv = fopen(csvPath, "w")) == NULL)
+		{
+			fprintf(stderr, "failed to open \"%s\" for writing\n", csvPath);
+			goto error;
+		}
+		fprintf(csv, "pipeline,rank,param1,value1,param2,value2,jitter,full_ms,diag_flips,score\n");
+	}
+
+	// The pipelines share no parameters, so each sweeps its own grid
+	for (int p = 0; p < NUM_PIPES; ++p)
+	{
+		const int count = ranges[p][0].steps * ranges[p][1].steps;
+		if ((results[p] = calloc((size_t)count, sizeof(Result))) == NULL)
+			goto error;
+
+		Sweep sweep = {(Pipeline)p, curve, {ranges[p][0], ranges[p][1]}, streams, numStreams, results[p]};
+		const uint64_t start = SDL_GetPerformanceCounter();
+		PoolRun(pool, count, EvalJob, &sweep);
+		const double elapsed = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+		ScoreResults(results[p], count, weights);
+		qsort(results[p], (size_t)count, sizeof(Result), CompareResults);
+
+		printf("\n%s", pipeNames[p]);
+		if (p == PIPE_ANALOGUE)
+			printf(" (%s curve)", CurveName(curve));
+		printf(", %d combinations in %.3f s\n", count, elapsed);
+		PrintTable(results[p], count, top);
+		if (csv)
+			WriteCSVRows(csv, results[p], count);
+	}
+	res = 0;
+
+error:
+	PoolDestroy(pool);
+	if (csv && fclose(csv))
+		res = 1;
+	for (int p = 0; p < NUM_PIPES; ++p)
+		free(results[p]);
+	for (int i = 0; i < numStreams; ++i)
+		free(streams[i].samples);
+	free(streams);
+	free(tracePaths);
+	return res;
+}